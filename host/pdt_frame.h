@@ -0,0 +1,190 @@
+#ifndef PDT_FRAME_H
+#define PDT_FRAME_H
+
+/*================================================================================*
+  PDT BINARY RESULT FRAME DECODER (host side, header only)
+
+  Decodes the frames the timer sends instead of text results when binary
+  results are selected ("Y1"). Feed every byte read from the port to
+  frame_decoder::feed(); text lines ("K", "B", ...) pass straight through
+  as FRAME_NONE so the same stream can carry both. A frame that fails its
+  header or CRC check is dropped and the decoder re-synchronizes on the next
+  sync byte, checking the bytes it already holds from there as if they had
+  just arrived, so a bad header among them is caught too. Sequence numbers
+  tell a repeated frame (SMSG_RSEND) apart from a new heat and count heats
+  that were missed in between.
+
+  The frame layout is documented in src/frame_functions.h.
+
+    pdt::frame_decoder dec;
+    pdt::heat_result heat;
+
+    if (dec.feed(c, &heat) == pdt::FRAME_OK && !heat.duplicate) ...
+ *================================================================================*/
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+namespace pdt {
+
+const uint8_t FRAME_SYNC      = 0xA5;
+const uint8_t FRAME_VERSION   = 1;
+const int     FRAME_MAX_LANES = 8;
+const int     FRAME_HEADER    = 8;
+const int     FRAME_MAX_SIZE  = FRAME_HEADER + 5 * FRAME_MAX_LANES + 2;
+
+enum frame_status
+{
+  FRAME_NONE,                          // byte is not part of a frame (text)
+  FRAME_PENDING,                       // byte consumed, frame not complete yet
+  FRAME_OK,                            // frame complete, result filled in
+  FRAME_BAD                            // frame rejected (header or CRC)
+};
+
+struct heat_result
+{
+  uint8_t  version;
+  uint16_t seq;                        // heat sequence number
+  int      lanes;
+  uint8_t  mask_bits;                  // masked lanes (bit per lane)
+  uint8_t  dnf_bits;                   // lanes that did not finish
+  uint8_t  ticks_per_us;               // timebase resolution
+  uint32_t ticks[FRAME_MAX_LANES];     // finish time, ticks from start
+  uint8_t  place[FRAME_MAX_LANES];
+
+  bool     duplicate;                  // same sequence number as the last frame
+  uint16_t missed;                     // heats skipped since the last frame
+
+  bool masked(int lane) const   { return (mask_bits >> lane) & 1; }
+  bool finished(int lane) const { return !masked(lane) && !((dnf_bits >> lane) & 1); }
+  double seconds(int lane) const { return ticks[lane] / (ticks_per_us * 1e6); }
+};
+
+
+inline uint16_t frame_crc(const uint8_t *buf, size_t len)
+{
+  uint16_t crc = 0xFFFF;
+
+  for (size_t i=0; i<len; i++)
+  {
+    crc ^= (uint16_t)(buf[i] << 8);
+    for (int b=0; b<8; b++)
+    {
+      crc = (crc & 0x8000) ? (uint16_t)((crc << 1) ^ 0x1021) : (uint16_t)(crc << 1);
+    }
+  }
+
+  return crc;
+}
+
+
+/*================================================================================*
+  DECODE ONE COMPLETE FRAME (buf starts at the sync byte)
+ *================================================================================*/
+inline bool frame_decode(const uint8_t *buf, size_t len, heat_result *r)
+{
+  int lanes;
+  size_t p;
+
+
+  if (len < (size_t)FRAME_HEADER + 2 || buf[0] != FRAME_SYNC || buf[1] != FRAME_VERSION) return false;
+
+  lanes = buf[2];
+  if (lanes < 1 || lanes > FRAME_MAX_LANES || len != (size_t)(FRAME_HEADER + 5 * lanes + 2)) return false;
+  if (frame_crc(buf + 1, len - 3) != (uint16_t)(buf[len-2] | buf[len-1] << 8)) return false;
+
+  r->version      = buf[1];
+  r->lanes        = lanes;
+  r->seq          = (uint16_t)(buf[3] | buf[4] << 8);
+  r->mask_bits    = buf[5];
+  r->dnf_bits     = buf[6];
+  r->ticks_per_us = buf[7];
+
+  p = FRAME_HEADER;
+  for (int n=0; n<lanes; n++, p+=5)
+  {
+    r->ticks[n] = (uint32_t)buf[p] | (uint32_t)buf[p+1] << 8 | (uint32_t)buf[p+2] << 16 | (uint32_t)buf[p+3] << 24;
+    r->place[n] = buf[p+4];
+  }
+  r->duplicate = false;
+  r->missed    = 0;
+
+  return true;
+}
+
+
+/*================================================================================*
+  STREAMING DECODER
+ *================================================================================*/
+class frame_decoder
+{
+  public:
+    frame_decoder() : len(0), have_seq(false), last_seq(0) {}
+
+    frame_status feed(uint8_t c, heat_result *r)
+    {
+      bool bad = false, ok = false;
+
+
+      if (len == 0 && c != FRAME_SYNC) return FRAME_NONE;
+      if (len >= (size_t)FRAME_MAX_SIZE) drop(1);    // cannot happen: a call ends short of a frame or just after taking one
+
+      buf[len++] = c;
+
+      while (len)                      // buf starts at a sync byte
+      {
+        size_t need;
+
+        if (len < 3) break;
+        if (buf[1] != FRAME_VERSION || buf[2] < 1 || buf[2] > FRAME_MAX_LANES)
+        {
+          bad = true;
+          drop(1);
+          continue;
+        }
+
+        need = FRAME_HEADER + 5 * buf[2] + 2;
+        if (len < need) break;
+
+        if (!frame_decode(buf, need, r))
+        {
+          bad = true;                  // the bytes after the sync are checked again, from the next sync
+          drop(1);
+          continue;
+        }
+        drop(need);
+        ok = true;
+
+        r->duplicate = have_seq && r->seq == last_seq;
+        r->missed    = (have_seq && !r->duplicate) ? (uint16_t)(r->seq - last_seq - 1) : 0;
+        have_seq = true;
+        last_seq = r->seq;
+        break;                         // one frame per call, any after it are checked on the next byte
+      }
+
+      return ok ? FRAME_OK : bad ? FRAME_BAD : FRAME_PENDING;
+    }
+
+    void reset() { len = 0; have_seq = false; }
+    size_t held() const { return len; }    // bytes of an unfinished frame
+
+  private:
+    uint8_t  buf[FRAME_MAX_SIZE];
+    size_t   len;                      // bytes held
+    bool     have_seq;
+    uint16_t last_seq;
+
+    // drop n bytes, then anything up to the next sync byte
+    void drop(size_t n)
+    {
+      size_t i = n < len ? n : len;
+
+      while (i < len && buf[i] != FRAME_SYNC) i++;
+      len -= i;
+      memmove(buf, buf + i, len);
+    }
+};
+
+} // namespace pdt
+
+#endif //PDT_FRAME_H
@@ -0,0 +1,520 @@
+#include "capture_functions.h"
+#include "timebase_functions.h"
+
+/*================================================================================*
+  FINISH CAPTURE
+
+  Lane detectors can be on any of the Uno's three ports, PORTB (pins 8-13),
+  PORTC (A0-A5) and PORTD (pins 0-7), each watched by its own pin change
+  interrupt. Whichever fires, the ISR snapshots all three ports back to
+  back (three IN instructions), so lanes on different ports are sampled
+  within a few cycles of each other. The rising edges in a snapshot become
+  one event: a bit per lane that finished and a single timestamp, so cars
+  that cross together always share a time. Events go into a
+  single-producer/single-consumer ring which the racing loop drains, so
+  display and serial work never delay a finish time. Only the first rising
+  edge of each lane is captured per heat.
+
+  With a glitch filter (capture_begin(min_ticks)), a rising edge only
+  counts once the beam has stayed blocked for min_ticks. The edge is held
+  as pending, with its time, and a falling edge before then (a camera
+  flash, a flicker of sunlight) drops it, counts a glitch for the lane and
+  re-arms it. capture_read() releases pending lanes once they qualify,
+  earliest first, with the time of the rising edge, so the filter delays
+  when a finish is seen but not the time it gets. A beam that clears after
+  min_ticks but before capture_read() looked (the loop was busy) is a
+  finish all the same: the ISR queues it, after any lanes that rose before
+  it and are still pending, so events stay in order.
+
+  In photo finish mode (capture_begin(min_ticks, true)) the ISR also keeps
+  the time of every edge on each lane, beam breaks and restores in turn,
+  up to PHOTO_EDGES a lane. The lanes stay watched after capture_end()
+  until photo_end(), so the last car's restore is kept too. With photo
+  mode off this costs the ISR one test and the racing loop nothing.
+
+  The lane to (port, bit) table is made once from the lane pin numbers by
+  lane_map(); edges and lane states are decoded from a snapshot with the
+  table's masks.
+ *================================================================================*/
+struct capture_event {
+  unsigned int  lanes;                 // bit per lane
+  unsigned long time;
+};
+
+volatile capture_event cap_queue[CAPTURE_QSIZE];
+volatile byte cap_head = 0;            // written by ISR only
+volatile byte cap_tail = 0;            // written by main loop only
+
+volatile byte cap_armed[CAPTURE_PORTS];   // port bits still waiting for a finish
+volatile byte cap_last [CAPTURE_PORTS];   // previous port snapshot
+
+unsigned long          cap_width = 0;      // glitch filter: minimum pulse (ticks, 0 = off)
+volatile byte          pend_port[CAPTURE_PORTS];    // port bits risen, not yet held for cap_width
+volatile unsigned int  cap_pending = 0;    // same, bit per lane
+volatile unsigned long cap_rise[CAPTURE_LANES];     // rising edge time of each pending lane
+volatile unsigned int  cap_glitches[CAPTURE_LANES]; // pulses rejected since power-up
+
+volatile boolean       cap_photo = false;  // photo finish: recording every lane edge
+volatile byte          photo_count[PHOTO_LANES];    // edges seen this heat (even = break, odd = restore)
+volatile unsigned long photo_time[PHOTO_LANES][PHOTO_EDGES];    // first PHOTO_EDGES of them
+
+int  map_lanes = 0;                    // lanes in the table
+byte map_port  [CAPTURE_LANES];        // lane -> port (pin change group)
+byte map_mask  [CAPTURE_LANES];        // lane -> bit mask in its port
+byte port_lanes[CAPTURE_PORTS];        // lane bits in each port
+unsigned int cap_bits[CAPTURE_PORTS][8];    // port bit -> lane bit
+
+volatile byte gate_bit   = 0;          // PORTB bit of start gate while armed
+volatile byte gate_trip  = 0;          // PORTB value of gate bit when tripped
+byte          gate_pcmsk = 0;          // PCMSK0 bit of start gate while armed
+volatile boolean gate_tripped = false;
+volatile unsigned long gate_time;      // start gate trip time
+
+
+/*-----------------------------------------*
+  - enable the groups with pins to watch -
+ *-----------------------------------------*/
+static void pcint_enable()
+{
+  PCICR = (PCMSK0 ? _BV(PCIE0) : 0) | (PCMSK1 ? _BV(PCIE1) : 0) | (PCMSK2 ? _BV(PCIE2) : 0);
+}
+
+
+ISR(PCINT0_vect)
+{
+  byte snap[CAPTURE_PORTS];
+  unsigned long time;
+
+
+  port_snapshot(snap);
+  time = tb_ticks();
+
+  capture_edges(snap, time);           // PORTB is shared with the start gate
+  gate_edge(snap[0], time);
+}
+
+
+ISR(PCINT1_vect)
+{
+  byte snap[CAPTURE_PORTS];
+
+
+  port_snapshot(snap);
+  capture_edges(snap, tb_ticks());
+}
+
+
+ISR(PCINT2_vect)
+{
+  byte snap[CAPTURE_PORTS];
+
+
+  port_snapshot(snap);
+  capture_edges(snap, tb_ticks());
+}
+
+
+/*-----------------------------------------*
+  - stop watching the lanes -
+ *-----------------------------------------*/
+static void lanes_unwatch()
+{
+  PCMSK0 &= ~port_lanes[0];
+  PCMSK1  = 0;
+  PCMSK2  = 0;
+  pcint_enable();
+}
+
+
+/*-----------------------------------------*
+  - photo finish: keep the edges on one port (interrupt context) -
+ *-----------------------------------------*/
+static void photo_record(byte p, byte changed, unsigned long time)
+{
+  for (byte n=0; n<map_lanes && n<PHOTO_LANES; n++)
+  {
+    if (map_port[n] != p || !(changed & map_mask[n])) continue;
+
+    if (photo_count[n] < PHOTO_EDGES) photo_time[n][photo_count[n]] = time;
+    if (photo_count[n] < 255) photo_count[n]++;
+  }
+}
+
+
+/*================================================================================*
+  MAP LANE PINS TO PORTS
+ *================================================================================*/
+void lane_map(const byte lane_pins[], int num_lanes)
+{
+  map_lanes = min(num_lanes, CAPTURE_LANES);
+  memset(port_lanes, 0, sizeof(port_lanes));
+
+  for (int n=0; n<map_lanes; n++)
+  {
+    map_port[n] = PIN_PORT(lane_pins[n]);
+    map_mask[n] = _BV(PIN_BIT(lane_pins[n]));
+    port_lanes[map_port[n]] |= map_mask[n];
+    cap_bits[map_port[n]][PIN_BIT(lane_pins[n])] = 1U << n;
+  }
+
+  return;
+}
+
+
+/*================================================================================*
+  LANE STATES FROM ONE SNAPSHOT (bit per lane, set = beam blocked)
+ *================================================================================*/
+unsigned int lane_states()
+{
+  byte snap[CAPTURE_PORTS];
+  unsigned int states = 0;
+
+
+  port_snapshot(snap);
+
+  for (int n=0; n<map_lanes; n++)
+  {
+    if (snap[map_port[n]] & map_mask[n]) states |= 1U << n;
+  }
+
+  return states;
+}
+
+
+/*================================================================================*
+  ARM FINISH CAPTURE FOR A NEW HEAT
+ *================================================================================*/
+void capture_begin(unsigned long min_ticks, boolean photo)
+{
+  byte snap[CAPTURE_PORTS];
+  byte flags = 0;
+
+
+  cli();
+  cap_head  = 0;
+  cap_tail  = 0;
+  cap_width = min_ticks;
+  cap_pending = 0;
+  cap_photo = photo;
+  memset((void *)photo_count, 0, sizeof(photo_count));
+  for (byte p=0; p<CAPTURE_PORTS; p++)
+  {
+    cap_armed[p] = port_lanes[p];
+    cap_last[p]  = 0;                  // lanes already blocked finish immediately
+    pend_port[p] = 0;
+    if (port_lanes[p]) flags |= _BV(p);
+  }
+
+  port_snapshot(snap);
+  capture_edges(snap, tb_ticks());
+
+  PCMSK0 |= port_lanes[0];
+  PCMSK1  = port_lanes[1];
+  PCMSK2  = port_lanes[2];
+  PCIFR   = flags;                     // discard edges from before the heat (PCIFn is bit n)
+  pcint_enable();
+  sei();
+
+  return;
+}
+
+
+/*================================================================================*
+  DISARM FINISH CAPTURE (photo finish: lanes stay watched until photo_end)
+ *================================================================================*/
+void capture_end()
+{
+  if (!cap_photo) lanes_unwatch();
+  for (byte p=0; p<CAPTURE_PORTS; p++) cap_armed[p] = pend_port[p] = 0;
+  cap_pending = 0;
+
+  return;
+}
+
+
+/*-----------------------------------------*
+  - add an event to the ring (interrupts off) -
+ *-----------------------------------------*/
+static void queue_event(unsigned int lanes, unsigned long time)
+{
+  byte next = (cap_head + 1) & (CAPTURE_QSIZE - 1);
+
+
+  if (next == cap_tail) return;        // ring full (cannot happen, QSIZE > lanes)
+
+  cap_queue[cap_head].lanes = lanes;
+  cap_queue[cap_head].time  = time;
+  cap_head = next;
+}
+
+
+/*-----------------------------------------*
+  - take the earliest pending lanes held for cap_width by now (interrupts off) -
+ *-----------------------------------------*/
+static boolean pending_ready(unsigned long now, unsigned int *lanes, unsigned long *time)
+{
+  unsigned long first = 0;
+  unsigned int ready = 0, bit;
+
+
+  for (byte n=0; n<map_lanes; n++)
+  {
+    bit = 1U << n;
+    if (!(cap_pending & bit) || (now - cap_rise[n]) < cap_width) continue;
+
+    if (!ready || (long)(cap_rise[n] - first) < 0)
+    {
+      ready = bit;
+      first = cap_rise[n];
+    }
+    else if (cap_rise[n] == first)
+    {
+      ready |= bit;                    // same snapshot
+    }
+  }
+
+  cap_pending &= ~ready;
+  for (byte n=0; ready && n<map_lanes; n++)
+  {
+    if (ready & (1U << n)) pend_port[map_port[n]] &= ~map_mask[n];
+  }
+
+  *lanes = ready;
+  *time  = first;
+
+  return ready != 0;
+}
+
+
+/*================================================================================*
+  RECORD RISING EDGES FROM A PORT SNAPSHOT (interrupt context)
+ *================================================================================*/
+void capture_edges(const byte snap[], unsigned long time)
+{
+  byte rising, falling, changed;
+  unsigned int lanes = 0, fell = 0, bit;
+  unsigned long first;
+
+
+  for (byte p=0; p<CAPTURE_PORTS; p++)
+  {
+    if (cap_photo && (changed = (snap[p] ^ cap_last[p]) & port_lanes[p])) photo_record(p, changed, time);
+
+    rising  = snap[p] & ~cap_last[p] & cap_armed[p];
+    falling = ~snap[p] & cap_last[p] & pend_port[p];    // pending lane cleared
+    cap_last[p] = snap[p];
+    cap_armed[p] &= ~rising;
+    pend_port[p] = (pend_port[p] & ~falling) | (cap_width ? rising : 0);
+
+    for (byte b=0; rising | falling; b++, rising >>= 1, falling >>= 1)
+    {
+      if (rising & 1)  lanes |= cap_bits[p][b];
+      if (falling & 1) fell  |= cap_bits[p][b];
+    }
+  }
+
+  for (byte n=0; fell && n<map_lanes; n++)
+  {
+    bit = 1U << n;
+    if (!(fell & bit) || time - cap_rise[n] >= cap_width) continue;    // held long enough: a finish
+
+    cap_pending &= ~bit;               // glitch: lane re-armed
+    cap_armed[map_port[n]] |= map_mask[n];
+    cap_glitches[n]++;
+  }
+
+  if (cap_width)                       // held until the pulse is long enough (capture_read)
+  {
+    for (byte n=0; lanes && n<map_lanes; n++)
+    {
+      if (lanes & (1U << n)) cap_rise[n] = time;
+    }
+    cap_pending |= lanes;
+
+    while (fell && pending_ready(time, &lanes, &first))    // a finish cleared before capture_read() saw
+    {                                                      // it: queue it, and the earlier ones, in order
+      queue_event(lanes, first);
+    }
+    return;
+  }
+
+  if (lanes) queue_event(lanes, time);
+
+  return;
+}
+
+
+/*================================================================================*
+  RELEASE PENDING LANES HELD FOR THE MINIMUM PULSE (earliest edge first)
+ *================================================================================*/
+boolean capture_qualify(unsigned int *lanes, unsigned long *time)
+{
+  boolean ready;
+
+
+  cli();
+  ready = pending_ready(tb_ticks(), lanes, time);
+  sei();
+
+  return ready;
+}
+
+
+/*================================================================================*
+  LANES HELD BY THE GLITCH FILTER THAT ROSE BY A TIME (not yet a finish or a glitch)
+ *================================================================================*/
+unsigned int capture_held(unsigned long by)
+{
+  unsigned int held = 0;
+
+
+  if (!cap_pending) return 0;
+
+  cli();
+  for (byte n=0; n<map_lanes; n++)
+  {
+    if ((cap_pending & (1U << n)) && (long)(cap_rise[n] - by) <= 0) held |= 1U << n;
+  }
+  sei();
+
+  return held;
+}
+
+
+/*================================================================================*
+  GLITCHES REJECTED ON A LANE SINCE POWER-UP
+ *================================================================================*/
+unsigned int capture_glitches(byte lane)
+{
+  unsigned int count;
+
+
+  cli();
+  count = lane < CAPTURE_LANES ? cap_glitches[lane] : 0;
+  sei();
+
+  return count;
+}
+
+
+/*================================================================================*
+  STOP RECORDING PHOTO FINISH EDGES (the heat's edges stay readable)
+ *================================================================================*/
+void photo_end()
+{
+  cli();
+  if (cap_photo) lanes_unwatch();
+  cap_photo = false;
+  sei();
+
+  return;
+}
+
+
+/*================================================================================*
+  PHOTO FINISH EDGES OF A LANE (returns the edges seen, the first PHOTO_EDGES are copied)
+ *================================================================================*/
+byte photo_edges(byte lane, unsigned long edge[])
+{
+  byte count;
+
+
+  if (lane >= PHOTO_LANES) return 0;
+
+  cli();
+  count = photo_count[lane];
+  for (byte i=0; i<count && i<PHOTO_EDGES; i++) edge[i] = photo_time[lane][i];
+  sei();
+
+  return count;
+}
+
+
+/*================================================================================*
+  READ NEXT CAPTURED FINISH EVENT (bit per lane, all at the same time)
+ *================================================================================*/
+boolean capture_read(unsigned int *lanes, unsigned long *time)
+{
+  byte tail = cap_tail;
+
+
+  if (tail == cap_head) return cap_pending ? capture_qualify(lanes, time) : false;
+
+  *lanes = cap_queue[tail].lanes;
+  *time  = cap_queue[tail].time;
+  cap_tail = (tail + 1) & (CAPTURE_QSIZE - 1);
+
+  return true;
+}
+
+
+/*================================================================================*
+  START GATE CAPTURE
+
+  The start gate sits on PORTB (pins 8-13) and is watched by the PCINT0 pin
+  change interrupt, so the trip is timestamped the moment it happens rather
+  than when loop() next gets around to the ready state. (Timer1 input
+  capture would need the gate on pin 8, which is wired to the reset switch.)
+ *================================================================================*/
+void gate_arm(byte gate_pin, byte trip_level)
+{
+  cli();
+  gate_bit  = _BV(gate_pin - 8);
+  gate_trip = trip_level ? gate_bit : 0;
+  gate_tripped = false;
+
+  gate_edge(PINB, tb_ticks());         // gate already open starts immediately
+
+  gate_pcmsk = gate_bit;
+  PCMSK0 |= gate_pcmsk;
+  PCIFR   = _BV(PCIF0);
+  pcint_enable();
+  sei();
+
+  return;
+}
+
+
+/*================================================================================*
+  DISARM START GATE CAPTURE
+ *================================================================================*/
+void gate_disarm()
+{
+  PCMSK0 &= ~gate_pcmsk;
+  pcint_enable();
+  gate_pcmsk = 0;
+  gate_bit = 0;
+
+  return;
+}
+
+
+/*================================================================================*
+  RECORD START GATE TRIP FROM A PORT SNAPSHOT (interrupt context)
+ *================================================================================*/
+void gate_edge(byte port, unsigned long time)
+{
+  if (!gate_bit || (port & gate_bit) != gate_trip) return;
+
+  gate_time = time;
+  gate_tripped = true;
+  gate_bit = 0;                        // ignore switch bounce until re-armed
+
+  return;
+}
+
+
+/*================================================================================*
+  READ START GATE TRIP TIME
+ *================================================================================*/
+boolean gate_read(unsigned long *time)
+{
+  if (!gate_tripped) return false;
+
+  cli();
+  *time = gate_time;
+  gate_tripped = false;
+  sei();
+
+  return true;
+}
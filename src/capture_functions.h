@@ -0,0 +1,44 @@
+#ifndef CAPTURE_VARS_H
+#define CAPTURE_VARS_H
+
+#include <Arduino.h>
+#include "timer_config.h"              // NUM_LANES
+
+#define CAPTURE_QSIZE  16              // finish event ring size (power of 2, > lanes)
+#define PHOTO_LANES    NUM_LANES       // photo finish: lanes kept
+#define PHOTO_EDGES    4               // photo finish: edges kept per lane per heat (break, restore, one chatter)
+
+#define CAPTURE_LANES  8               // lanes mapped (MAX_LANE)
+#define CAPTURE_PORTS  3               // pin change groups: 0 PORTB (8-13), 1 PORTC (A0-A5), 2 PORTD (0-7)
+#define PIN_PORT(pin)  ((pin) < 8 ? 2 : (pin) < 14 ? 0 : 1)
+#define PIN_BIT(pin)   ((pin) < 8 ? (pin) : (pin) < 14 ? (pin) - 8 : (pin) - 14)
+
+/*-----------------------------------------*
+  - all lane ports, back to back -
+ *-----------------------------------------*/
+static inline void port_snapshot(byte snap[CAPTURE_PORTS])
+{
+  snap[0] = PINB;
+  snap[1] = PINC;
+  snap[2] = PIND;
+}
+
+void lane_map(const byte lane_pins[], int num_lanes);
+unsigned int lane_states();
+
+void capture_begin(unsigned long min_ticks=0, boolean photo=false);
+void capture_end();
+void capture_edges(const byte snap[], unsigned long time);
+boolean capture_qualify(unsigned int *lanes, unsigned long *time);
+unsigned int capture_held(unsigned long by);
+boolean capture_read(unsigned int *lanes, unsigned long *time);
+unsigned int capture_glitches(byte lane);
+void photo_end();
+byte photo_edges(byte lane, unsigned long edge[]);
+
+void gate_arm(byte gate_pin, byte trip_level);
+void gate_disarm();
+void gate_edge(byte port, unsigned long time);
+boolean gate_read(unsigned long *time);
+
+#endif //CAPTURE_VARS_H
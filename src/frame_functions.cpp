@@ -0,0 +1,60 @@
+#include "frame_functions.h"
+#include "timebase_functions.h"
+
+/*================================================================================*
+  CRC-16/CCITT
+
+  Bitwise rather than table driven; a frame is only a few dozen bytes and
+  the table would cost 512 bytes of flash.
+ *================================================================================*/
+unsigned int frame_crc(const byte *buf, int len)
+{
+  unsigned int crc = 0xFFFF;
+
+  for (int i=0; i<len; i++)
+  {
+    crc ^= (unsigned int)buf[i] << 8;
+    for (int b=0; b<8; b++)
+    {
+      crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+  }
+
+  return crc & 0xFFFF;
+}
+
+
+/*================================================================================*
+  ENCODE RESULT FRAME (returns frame length)
+ *================================================================================*/
+int frame_encode(byte *buf, unsigned int seq, int num_lanes, const unsigned long lane_ticks[],
+                 const int lane_place[], byte mask_bits, byte dnf_bits)
+{
+  int len = 0;
+  unsigned int crc;
+
+
+  buf[len++] = FRAME_SYNC;
+  buf[len++] = FRAME_VERSION;
+  buf[len++] = num_lanes;
+  buf[len++] = seq & 0xFF;
+  buf[len++] = seq >> 8;
+  buf[len++] = mask_bits;
+  buf[len++] = dnf_bits;
+  buf[len++] = TB_TICKS_PER_US;
+
+  for (int n=0; n<num_lanes; n++)
+  {
+    buf[len++] = lane_ticks[n] & 0xFF;
+    buf[len++] = (lane_ticks[n] >> 8) & 0xFF;
+    buf[len++] = (lane_ticks[n] >> 16) & 0xFF;
+    buf[len++] = lane_ticks[n] >> 24;
+    buf[len++] = lane_place[n];
+  }
+
+  crc = frame_crc(buf + 1, len - 1);
+  buf[len++] = crc & 0xFF;
+  buf[len++] = crc >> 8;
+
+  return len;
+}
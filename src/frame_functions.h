@@ -0,0 +1,29 @@
+#ifndef FRAME_VARS_H
+#define FRAME_VARS_H
+
+#include <Arduino.h>
+
+/*================================================================================*
+  BINARY RESULT FRAME (little endian, decoded by host/pdt_frame.h)
+
+    offset  size  field
+      0       1   FRAME_SYNC (never sent in the ASCII protocol)
+      1       1   FRAME_VERSION
+      2       1   number of lanes (L)
+      3       2   heat sequence number
+      5       1   masked lanes (bit per lane)
+      6       1   did not finish lanes (bit per lane)
+      7       1   timebase ticks per microsecond
+      8     5*L   per lane: finish time (4 bytes, ticks from start), place (1 byte)
+    8+5*L     2   CRC-16/CCITT (poly 0x1021, init 0xFFFF) of bytes 1 .. 7+5*L
+ *================================================================================*/
+#define FRAME_SYNC       0xA5
+#define FRAME_VERSION    1
+#define FRAME_MAX_LANES  8
+#define FRAME_SIZE(l)    (8 + 5 * (l) + 2)
+
+int frame_encode(byte *buf, unsigned int seq, int num_lanes, const unsigned long lane_ticks[],
+                 const int lane_place[], byte mask_bits, byte dnf_bits);
+unsigned int frame_crc(const byte *buf, int len);
+
+#endif //FRAME_VARS_H
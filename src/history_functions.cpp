@@ -0,0 +1,233 @@
+#include <EEPROM.h>
+#include "history_functions.h"
+#include "frame_functions.h"           // frame_crc()
+
+/*================================================================================*
+  HEAT HISTORY
+
+  Finished heats are kept by heat ID (the heat sequence number) so a host
+  that lost results can ask for any of them again. The newest HIST_RAM
+  heats are in SRAM; each one is also copied to an EEPROM ring that fills
+  the rest of the EEPROM, by hist_service() one byte per call as with the
+  saved heat, so the history outlives the SRAM ring and power cycles.
+
+  A heat is stored packed, 4 * lanes + 5 bytes (21 for 4 lanes):
+    per lane   4 bytes   time (timebase ticks, low HIST_TICK_BITS) | place << HIST_TICK_BITS
+               2 bytes   heat ID
+               1 byte    masked lanes (bit per lane)
+               2 bytes   CRC-16 of the bytes above (a blank or half written slot fails)
+ *================================================================================*/
+#define HIST_REC_MAX   (4 * HIST_LANES + 5)
+#define TICK_MASK      ((1UL << HIST_TICK_BITS) - 1)
+
+byte hist_ram[HIST_RAM][HIST_REC_MAX]; // newest heats
+byte ram_count;                        // heats in hist_ram
+byte ram_next;                         // hist_ram slot for the next heat
+byte ram_unsaved;                      // newest heats not yet copied to EEPROM
+int  hist_lanes;                       // lanes per heat
+int  hist_len;                         // bytes per heat
+int  ee_slots;                         // heats that fit in EEPROM
+int  ee_next;                          // EEPROM slot being (or next to be) written
+int  ee_hpos = -1;                     // next byte of ee_rec to write (-1 = idle)
+byte ee_rec[HIST_REC_MAX];             // heat being written
+
+
+/*-----------------------------------------*
+  - record fields -
+ *-----------------------------------------*/
+unsigned int rec_id(const byte *rec)
+{
+  return rec[4 * hist_lanes] | (unsigned int)rec[4 * hist_lanes + 1] << 8;
+}
+
+
+unsigned int rec_crc(const byte *rec)
+{
+  return frame_crc(rec, hist_len - 2);
+}
+
+
+boolean rec_valid(const byte *rec)
+{
+  return rec_crc(rec) == (rec[hist_len - 2] | (unsigned int)rec[hist_len - 1] << 8);
+}
+
+
+/*-----------------------------------------*
+  - read an EEPROM slot -
+ *-----------------------------------------*/
+void ee_read(int slot, byte *rec)
+{
+  for (int i=0; i<hist_len; i++) rec[i] = EEPROM.read(HIST_EE_BASE + slot * hist_len + i);
+}
+
+
+/*================================================================================*
+  START HISTORY (finds the newest heat in EEPROM)
+ *================================================================================*/
+void hist_begin(int num_lanes)
+{
+  byte rec[HIST_REC_MAX];
+  int newest = -1;
+  unsigned int newest_id = 0;
+
+
+  hist_lanes = min(num_lanes, HIST_LANES);
+  hist_len = 4 * hist_lanes + 5;
+  ee_slots = (EEPROM.length() - HIST_EE_BASE) / hist_len;
+  ram_count = ram_next = ram_unsaved = 0;
+  ee_hpos = -1;
+
+  for (int s=0; s<ee_slots; s++)
+  {
+    ee_read(s, rec);
+    if (!rec_valid(rec)) continue;
+    if (newest < 0 || (int16_t)(rec_id(rec) - newest_id) > 0)
+    {
+      newest = s;
+      newest_id = rec_id(rec);
+    }
+  }
+  ee_next = (newest + 1) % ee_slots;
+
+  return;
+}
+
+
+/*================================================================================*
+  ADD FINISHED HEAT
+ *================================================================================*/
+void hist_add(unsigned int id, const unsigned long lane_time[], const int lane_place[], const boolean lane_mask[])
+{
+  byte *rec = hist_ram[ram_next];
+  unsigned long lane;
+  unsigned int crc;
+  byte mask = 0;
+
+
+  for (int n=0; n<hist_lanes; n++)
+  {
+    lane = (lane_time[n] & TICK_MASK) | (unsigned long)lane_place[n] << HIST_TICK_BITS;
+    rec[4*n]     = lane & 0xFF;
+    rec[4*n + 1] = (lane >> 8) & 0xFF;
+    rec[4*n + 2] = (lane >> 16) & 0xFF;
+    rec[4*n + 3] = (lane >> 24) & 0xFF;
+    if (lane_mask[n]) mask |= _BV(n);
+  }
+  rec[4 * hist_lanes]     = id & 0xFF;
+  rec[4 * hist_lanes + 1] = (id >> 8) & 0xFF;
+  rec[4 * hist_lanes + 2] = mask;
+
+  crc = rec_crc(rec);
+  rec[hist_len - 2] = crc & 0xFF;
+  rec[hist_len - 1] = crc >> 8;
+
+  ram_next = (ram_next + 1) % HIST_RAM;
+  if (ram_count < HIST_RAM) ram_count++;
+  if (ram_unsaved < HIST_RAM) ram_unsaved++;    // a full ring drops its oldest unsaved heat
+
+  return;
+}
+
+
+/*================================================================================*
+  GET HEAT BY ID (SRAM first, then EEPROM)
+ *================================================================================*/
+boolean hist_get(unsigned int id, unsigned long lane_time[], int lane_place[], boolean lane_mask[])
+{
+  byte rec[HIST_REC_MAX];
+  const byte *found = NULL;
+  unsigned long lane;
+
+
+  id &= 0xFFFF;
+
+  for (int i=1; i<=ram_count && !found; i++)    // newest first
+  {
+    const byte *r = hist_ram[(ram_next + HIST_RAM - i) % HIST_RAM];
+
+    if (rec_id(r) == id) found = r;
+  }
+
+  for (int i=1; i<=ee_slots && !found; i++)    // newest first
+  {
+    int s = (ee_next + ee_slots - i) % ee_slots;
+
+    if (EEPROM.read(HIST_EE_BASE + s * hist_len + 4 * hist_lanes) != (id & 0xFF)) continue;
+    ee_read(s, rec);
+    if (rec_id(rec) == id && rec_valid(rec)) found = rec;
+  }
+
+  if (!found) return false;
+
+  for (int n=0; n<hist_lanes; n++)
+  {
+    lane = found[4*n] | (unsigned long)found[4*n + 1] << 8 | (unsigned long)found[4*n + 2] << 16 |
+           (unsigned long)found[4*n + 3] << 24;
+    lane_time[n]  = lane & TICK_MASK;
+    lane_place[n] = lane >> HIST_TICK_BITS;
+    lane_mask[n]  = found[4 * hist_lanes + 2] & _BV(n);
+  }
+
+  return true;
+}
+
+
+/*================================================================================*
+  IDS HELD (returns the number of heats from first to last, 0 = none)
+ *================================================================================*/
+int hist_range(unsigned int *first, unsigned int *last)
+{
+  byte rec[HIST_REC_MAX];
+  boolean any = false;
+  unsigned int id;
+
+
+  for (int i=0; i<ram_count + ee_slots; i++)
+  {
+    if (i < ram_count)
+    {
+      id = rec_id(hist_ram[i]);
+    }
+    else
+    {
+      ee_read(i - ram_count, rec);
+      if (!rec_valid(rec)) continue;
+      id = rec_id(rec);
+    }
+
+    if (!any || (int16_t)(id - *last) > 0) *last = id;
+    if (!any || (int16_t)(id - *first) < 0) *first = id;
+    any = true;
+  }
+
+  return any ? (uint16_t)(*last - *first) + 1 : 0;
+}
+
+
+/*================================================================================*
+  COPY TO EEPROM (one byte per call, false = nothing left to write)
+ *================================================================================*/
+boolean hist_service()
+{
+  if (ee_hpos < 0)
+  {
+    if (!ram_unsaved || !ee_slots) return false;
+
+    memcpy(ee_rec, hist_ram[(ram_next + HIST_RAM - ram_unsaved) % HIST_RAM], hist_len);
+    ram_unsaved--;
+    ee_hpos = 0;
+  }
+
+  if (!eeprom_is_ready()) return true;    // previous byte still being written
+
+  EEPROM.update(HIST_EE_BASE + ee_next * hist_len + ee_hpos, ee_rec[ee_hpos]);
+
+  if (++ee_hpos >= hist_len)
+  {
+    ee_hpos = -1;
+    ee_next = (ee_next + 1) % ee_slots;
+  }
+
+  return true;
+}
@@ -0,0 +1,18 @@
+#ifndef HISTORY_VARS_H
+#define HISTORY_VARS_H
+
+#include <Arduino.h>
+#include "timer_config.h"              // NUM_LANES
+
+#define HIST_LANES     NUM_LANES       // lanes kept
+#define HIST_RAM       4               // newest heats kept in SRAM
+#define HIST_EE_BASE   384             // first EEPROM byte used (after the saved heat, save_functions.h)
+#define HIST_TICK_BITS 28              // packed lane: time in the low bits, place above
+
+void hist_begin(int num_lanes);
+void hist_add(unsigned int id, const unsigned long lane_time[], const int lane_place[], const boolean lane_mask[]);
+boolean hist_get(unsigned int id, unsigned long lane_time[], int lane_place[], boolean lane_mask[]);
+int hist_range(unsigned int *first, unsigned int *last);
+boolean hist_service();
+
+#endif //HISTORY_VARS_H
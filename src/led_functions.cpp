@@ -4,6 +4,11 @@
 //                Display #    1     2     3     4     5     6     7     8
 int  DISP_ADD [MAX_DISP] = {0x70, 0x71, 0x72, 0x73, 0x74, 0x75, 0x76, 0x77};    // display I2C addresses
 
+byte disp_pending = 0;                   // displays waiting to be written (bit per address)
+byte disp_urgent  = 0;                   // pending displays showing race results
+byte disp_next    = 0;                   // next display to check for a pending write
+unsigned long disp_bus_us = 0;           // longest write_display() (microseconds)
+
 void setup_displays() {
   for (int n=0; n<MAX_DISP; n++)
   {
@@ -21,6 +26,62 @@ void setup_displays() {
 #endif
   }
 
+  Wire.setClock(I2C_SPEED);              // after begin(), which resets the bus to 100 kHz
+}
+
+/*================================================================================*
+  DISPLAY WRITE QUEUE
+
+  Drawing only changes the RAM buffer held by each display object and marks
+  its address pending, so repeated updates to one display coalesce into a
+  single write. service_displays() sends at most one display per call,
+  urgent (place/time) displays before blanking. This splits the writes, it
+  does not take them off the loop: each call still waits in Wire for one
+  whole display transaction (about 0.4 ms at 400 kHz), since the TWI
+  interrupt belongs to the Wire library. disp_bus_us keeps the longest of
+  these waits; the drawing itself is timed in main.cpp (DISP UPDATE us).
+ *================================================================================*/
+void write_display(int n) {
+  unsigned long t0 = micros();
+
+#ifdef DUAL_MODE
+  if (n >= 4) disp_8x8[n].writeDisplay();
+  else        disp_mat[n].writeDisplay();
+#else
+  disp_mat[n].writeDisplay();
+#endif
+
+  disp_bus_us = max(disp_bus_us, micros() - t0);
+}
+
+void queue_display(int n, boolean urgent) {
+#ifdef LED_QUEUE
+  disp_pending |= _BV(n);
+  if (urgent) disp_urgent |= _BV(n);
+#else
+  write_display(n);
+#endif
+}
+
+boolean service_displays() {
+  byte pend = disp_urgent ? disp_urgent : disp_pending;
+
+  if (!pend) return false;
+
+  while (!(pend & _BV(disp_next))) {
+    disp_next = (disp_next + 1) % MAX_DISP;
+  }
+  disp_pending &= ~_BV(disp_next);
+  disp_urgent  &= ~_BV(disp_next);
+
+  write_display(disp_next);
+  return true;
+}
+
+void flush_displays() {
+  while (disp_pending) {
+    service_displays();
+  }
 }
 
 void show_brightness_pattern() {
@@ -41,7 +102,7 @@ void show_brightness_pattern() {
       disp_mat[n].writeDigitNum(4, char2int(ctmp[3]), false);
 
       disp_mat[n].drawColon(false);
-      disp_mat[n].writeDisplay();
+      queue_display(n);
 
 #ifdef DUAL_DISP
 #ifdef DUAL_MODE
@@ -50,7 +111,7 @@ void show_brightness_pattern() {
       disp_8x8[n+4].setRotation(3);
       disp_8x8[n+4].setCursor(2, 0);
       disp_8x8[n+4].print("X");
-      disp_8x8[n+4].writeDisplay();
+      queue_display(n+4);
 #else
       disp_mat[n+4].clear();
 
@@ -60,7 +121,7 @@ void show_brightness_pattern() {
       disp_mat[n+4].writeDigitNum(4, char2int(ctmp[3]), false);
 
       disp_mat[n+4].drawColon(false);
-      disp_mat[n+4].writeDisplay();
+      queue_display(n+4);
 #endif
 #endif
     }
@@ -113,13 +174,9 @@ void update_display(int lane, unsigned char msg[]) {
 #endif
   }
 
-  disp_mat[lane].writeDisplay();
+  queue_display(lane);
 #ifdef DUAL_DISP
-#ifdef DUAL_MODE
-  disp_8x8[lane+4].writeDisplay();
-#else
-  disp_mat[lane+4].writeDisplay();
-#endif
+  queue_display(lane+4);
 #endif
 
   return;
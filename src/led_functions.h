@@ -8,8 +8,11 @@
 #include "Wire.h"
 #include "Adafruit_LEDBackpack.h"
 #include "Adafruit_GFX.h"
+#include "timer_config.h"              // NUM_LANES
 
 #define MAX_DISP       8                 // number of displays
+#define LED_QUEUE      1                 // queue display writes (comment out to write immediately)
+#define I2C_SPEED      400000            // display bus clock (Hz)
 
 #ifdef LARGE_DISP
 unsigned char msgGateC[] = {0x6D, 0x41, 0x00, 0x0F, 0x07};  // S=CL
@@ -27,6 +30,7 @@ unsigned char msgDashL[] = {0x00, 0x00, 0x00, 0x40, 0x00};  //   -
 unsigned char msgBlank[] = {0x00, 0x00, 0x00, 0x00, 0x00};  // (blank)
 
 Adafruit_7segment disp_mat[MAX_DISP];
+extern unsigned long disp_bus_us;      // longest single display write on the bus (microseconds)
 
 #ifdef DUAL_MODE                       // uses 8x8 matrix displays
 Adafruit_8x8matrix disp_8x8[MAX_DISP];
@@ -36,6 +40,9 @@ void setup_displays();
 void show_brightness_pattern();
 void set_display_brightness(int display_level);
 void update_display(int lane, unsigned char msg[]);
+void queue_display(int n, boolean urgent=false);
+boolean service_displays();
+void flush_displays();
 
 #endif //LED_DISPLAY
 
@@ -28,10 +28,12 @@
 /*-----------------------------------------*
   - TIMER CONFIGURATION -
  *-----------------------------------------*/
-#define NUM_LANES    4                 // number of lanes
+// NUM_LANES (number of lanes) is set in timer_config.h, shared with the displays
 #define GATE_RESET   0                 // Enable closing start gate to reset timer
+#define AUTO_REARM   0                 // continuous heats at power-up: rearm by itself once the track is clear
+#define REARM_CLEAR  500               // time (msecs) gate closed and lanes clear before rearming
 
-#define ENABLE_DISPLAYS 1
+#define ENABLE_DISPLAYS 1              // display options are #ifdefs, not RaceEngine parameters (race_engine.h)
 //Define one or the other of these (either Arduino led displays or MAX7219 based matricies)
 //#define LED_DISPLAY  1                 // Enable lane place/time displays
 #define MATRIX_DISPLAY 1               //Enable use of 8x8 matrices
@@ -46,6 +48,24 @@
 #define MAX_BRIGHT   15                // maximum display brightness (0-15)
 
 #define ENABLE_TIMEOUT  1              // Enable line timeout (time > NULL_TIME)
+#define TIMEOUT_MODE 0                 // power-up heat timeout: 0 NULL_TIME, 1 winner multiple, 2 session spread
+#define DNF_LEADER   15                // mode 1: lanes still out at this multiple (tenths) of the winner's time are DNF
+#define DNF_SPREAD   30                // mode 2: ... at the winner + this multiple (tenths) of the mean spread
+#define DNF_MIN      1000              // adaptive timeouts never end a heat sooner (msecs) after the winner
+#define GLITCH_US    1000              // lane pulse (usecs) shorter than this is a glitch, not a finish (0 = off)
+#define PHOTO_FINISH 0                 // photo finish at power-up: record every lane edge (SMSG_PHOTO)
+#define PHOTO_TAIL   250               // time (msecs) edges are still recorded after the heat (last car's restore)
+#define CAR_MM       178               // car length (mm) for photo finish speeds (7 in)
+#define FAST_BOOT    1                 // ready at once; banner shown while ready, power-on only
+#define WATCHDOG     WDTO_4S           // restart if loop() stalls (e.g. hung display bus), last heat kept
+
+#define SERIAL_BAUD  9600              // power-up serial baud (legacy protocol)
+#define BAUD_CONFIRM 1000              // time (msecs) for the host to confirm a new baud
+#define BAUD_DRAIN   20                // time (msecs) to send the baud reply before switching
+
+#define DISP_WINDOW  50                // hold racing display writes (msecs) after a finish while lanes remain
+#define DISP_BUDGET  500               // display bus time (usecs) allowed per racing loop pass
+#define DUMP_ROOM    60                // free TX buffer (bytes) before the next heat of a history dump
 
 char packnum[4] = {'P', '2', '2', '0'}; //start message (pack numbner)
 
@@ -54,25 +74,46 @@ char packnum[4] = {'P', '2', '2', '0'}; //start message (pack numbner)
  *-----------------------------------------*/
 
 
+#include <avr/wdt.h>
+
+#include "timer_config.h"
 #ifdef LED_DISPLAY                     // LED DISPLAY library
 #include "led_functions.h"
 #elif MATRIX_DISPLAY                   // LED MATRIX library
 #include "matrix_functions.h"
 #endif
+#include "capture_functions.h"
+#include "timebase_functions.h"
+#include "profile_functions.h"
+#include "frame_functions.h"
+#include "serial_functions.h"
+#include "task_functions.h"
+#include "reset_functions.h"
+#include "ram_functions.h"
+#include "save_functions.h"
+#include "history_functions.h"
+#include "photo_functions.h"
+#include "race_engine.h"
 
 /*-----------------------------------------*
   - static definitions -
  *-----------------------------------------*/
 #define PDT_VERSION  "3.20"            // software version
-#define MAX_LANE     6                 // maximum number of lanes (Uno)
+#define MAX_LANE     8                 // maximum number of lanes (Uno)
 
 #define mREADY       0                 // program modes
 #define mRACING      1
 #define mFINISH      2
 #define mTEST        3
+#define mBOOT        4                 // start-up banner showing (without FAST_BOOT)
+
+#define tmFIXED      0                 // heat timeout modes (SMSG_TMOUT)
+#define tmLEADER     1
+#define tmSPREAD     2
 
 #define START_TRIP   LOW              // start switch trip condition (HIGH for Track, LOW for Test Setup)
-#define NULL_TIME    9.999             // null (non-finish) time
+#define NULL_TIME    9999              // null (non-finish) time (milliseconds)
+#define NULL_TICKS   (NULL_TIME * (TB_TICKS_PER_SEC / 1000))
 #define NUM_DIGIT    4                 // timer resolution (# of decimals)
 #define DISP_DIGIT   4                 // total number of display digits
 
@@ -85,6 +126,7 @@ char packnum[4] = {'P', '2', '2', '0'}; //start message (pack numbner)
 //                                        -> from timer
 //
 #define SMSG_ACKNW   '.'               // -> acknowledge message
+#define SMSG_CMDER   CMD_BAD           // -> framed command not understood
 
 #define SMSG_POWER   'P'               // -> start-up (power on or hard reset)
 
@@ -97,7 +139,7 @@ char packnum[4] = {'P', '2', '2', '0'}; //start message (pack numbner)
 #define SMSG_SOLEN   'S'               // <- start solenoid
 #define SMSG_START   'B'               // -> race started
 #define SMSG_FORCE   'F'               // <- force end
-#define SMSG_RSEND   'Q'               // <- resend race data
+#define SMSG_RSEND   'Q'               // <- resend race data (framed <Q id> or <Q first,last>: from history)
 
 #define SMSG_LMASK   'M'               // <- mask lane
 #define SMSG_UMASK   'U'               // <- unmask all lanes
@@ -106,11 +148,21 @@ char packnum[4] = {'P', '2', '2', '0'}; //start message (pack numbner)
 #define SMSG_DEBUG   'D'               // <- toggle debug on/off
 #define SMSG_GNUML   'N'               // <- request number of lanes
 #define SMSG_TINFO   'I'               // <- request timer information
+#define SMSG_PROF    'H'               // <- request racing loop profile (ENABLE_PROFILE)
+#define SMSG_SBAUD   'X'               // <- set serial baud (rate code, then 'X' at the new baud)
+#define SMSG_RFMT    'Y'               // <- result format ('0' text, '1' binary frame)
+#define SMSG_AUTO    'A'               // <- continuous heats ('1' rearm automatically, '0' wait for reset)
+#define SMSG_TMOUT   'T'               // <- heat timeout mode (tm*, framed <T1,15> also sets the multiple)
+#define SMSG_GLTCH   'J'               // <- request rejected lane glitches since power-up
+#define SMSG_PHOTO   'E'               // <- photo finish ('1' record lane edges, '0' off, no digit = send last heat's)
 
 #define SMSG_PACK    '2'               // <- show pack on displays
 #define SMSG_LANES   'L'               // <- show lanes on displays
 #define SMSG_CHECK   'C'               // <- start lane sensor check
 
+// M, X, Y, A, T and E take one digit (M3), or send any command framed with arguments: <M1,3,4>
+const char SMSG_ARGS[] = {SMSG_LMASK, SMSG_SBAUD, SMSG_RFMT, SMSG_AUTO, SMSG_TMOUT, SMSG_PHOTO, 0};
+
 
 /*-----------------------------------------*
   - pin assignments -
@@ -119,14 +171,22 @@ byte BRIGHT_LEV   = A0;                // brightness level
 byte RESET_SWITCH =  8;                // reset switch
 byte STATUS_LED_R =  9;                // status LED (red)
 byte STATUS_LED_B = 10;                // status LED (blue)
+#ifdef MATRIX_HW_SPI
+byte STATUS_LED_G =  6;                // status LED (green) - pin 11 is SPI MOSI
+#else
 byte STATUS_LED_G = 11;                // status LED (green)
+#endif
 byte START_GATE   = 12;                // start gate switch
 #ifndef MATRIX_DISPLAY
 byte START_SOL    = 13;                // start solenoid
 #endif
 
-//                   Lane #    1     2     3     4     5     6
-byte LANE_DET [MAX_LANE] = {   2,    3,    4,    5,    6,    7};                // finish detection pins
+//                   Lane #    1     2     3     4     5     6     7     8
+byte LANE_DET [MAX_LANE] = {   2,    3,    4,    5,    6,    7,   A1,   A2};    // finish detection pins (any port)
+
+//                   Code    '0'     '1'     '2'     '3'      '4'
+unsigned long BAUD_RATE [] = {9600, 115200, 250000, 500000, 1000000};          // SMSG_SBAUD rates
+#define NUM_BAUD     (sizeof(BAUD_RATE) / sizeof(BAUD_RATE[0]))
 
 /*-----------------------------------------*
   - global variables -
@@ -135,38 +195,98 @@ boolean       fDebug = false;          // debug flag
 boolean       ready_first;             // first pass in ready state flag
 boolean       finish_first;            // first pass in finish state flag
 
-unsigned long start_time;              // race start time (microseconds)
-unsigned long lane_time  [MAX_LANE];   // lane finish time (microseconds)
+unsigned long start_time;              // race start time (timebase ticks)
+unsigned long lane_time  [MAX_LANE];   // lane finish time (timebase ticks)
 int           lane_place [MAX_LANE];   // lane finish place
 boolean       lane_mask  [MAX_LANE];   // lane mask status
 
-int           serial_data;             // serial data
+int           serial_data;             // serial data (command code)
+command       cmd;                     // last command received, with arguments
+unsigned long serial_baud = SERIAL_BAUD;    // current serial baud
+unsigned long baud_prev;               // baud to go back to if the host does not confirm
+byte          test_step;               // hardware test being shown (test_task)
+boolean       fBinary = false;         // send results as binary frames
+boolean       fAuto = AUTO_REARM;      // continuous heats (rearm without SMSG_RESET)
+boolean       fPhoto = PHOTO_FINISH;   // photo finish: record every lane edge during a heat
+unsigned long photo_start;             // start time of the heat the photo finish edges are from
+byte          photo_line;              // next photo finish line to send (photo_send_task)
+unsigned long track_clear_ms;          // millis() when the track was last seen not clear (fAuto)
+byte          timeout_mode = TIMEOUT_MODE;    // heat timeout mode (tm*)
+byte          dnf_factor = TIMEOUT_MODE == tmSPREAD ? DNF_SPREAD : DNF_LEADER;    // multiple (tenths)
+unsigned long spread_avg = 0;          // session mean winner-to-last spread (ticks, 0 = no heats yet)
+unsigned int  heat_seq = 0;            // heat sequence number (binary frames)
+boolean       results_held = false;    // finished heat not yet reset by the host (kept across resets)
+byte          heat_restored = SAVE_NONE;    // where setup() found the saved heat (SAVE_*)
+unsigned int  dump_next;               // next heat ID of a history dump (dump_task)
+unsigned int  dump_left;               // heat IDs left to send
 byte          mode;                    // current program mode
 
-float         display_level = -1.0;    // display brightness level
+int           display_level = -10;     // display brightness level (tenths)
+unsigned long disp_clear_us = 0;       // longest clear_displays() (microseconds)
+unsigned long disp_update_us = 0;      // longest update_display() (microseconds)
+unsigned long boot_ready_us = 0;       // reset to ready/finish after power up (microseconds)
 
 
 //method declarations
 void initialize(boolean powerup=false);
-void dbg(int, const char * msg, int val=-999);
+void dbg(int, const __FlashStringHelper * msg, int val=-999);
 void smsg(char msg, boolean crlf=true);
 void smsg_str(const char * msg, boolean crlf=true);
 void timer_ready_state();
 void timer_racing_state();
+unsigned long heat_cutoff(unsigned long leader);
+void update_spread(unsigned long leader, unsigned long last);
 void set_status_led();
 void set_display_brightness();
 void update_display(int lane, int display_place, unsigned long display_time, int display_mode);
 void send_timer_info();
 void test_pdt_hw();
+void test_task();
 void check_lane_sensors();
+void lane_check_task();
+void boot_task();
+void boot_done();
+void restore_race_state();
+void save_race_state();
+void resume_heat();
+void show_pack_number();
+void gate_reset_task();
+boolean track_clear();
+void baud_switch_task();
+void baud_revert_task();
 void clear_displays();
+void schedule_displays(unsigned long last_edge, int lanes_left);
 int get_serial_data();
 void unmask_all_lanes();
 void send_race_results();
+void send_heat(unsigned int seq, const unsigned long time[], const int place[], const boolean mask[], boolean id_line);
+void dump_history(unsigned int first, unsigned int last);
+void dump_task();
+void photo_data(int lane, photo_lane *pl);
+void photo_task();
+void send_photo_data();
+void photo_send_task();
+void set_serial_baud(long code);
+void send_result_frame(unsigned int seq, const unsigned long time[], const int place[], const boolean mask[]);
 void display_race_results();
 void process_general_msgs();
 void timer_finished_state();
 
+/*-----------------------------------------*
+  - race engine (race_engine.h) -
+ *-----------------------------------------*/
+class Race : public RaceEngine<Race, NUM_LANES, NULL_TICKS>
+{
+public:
+  Race() : RaceEngine(lane_time, lane_place, lane_mask) {}
+
+  void lane_done(byte lane, boolean timeout);
+  unsigned long cutoff(unsigned long leader) { return heat_cutoff(leader); }
+  unsigned int held(unsigned long by) { return capture_held(by); }
+};
+
+Race race;                             // finish logic of the heat being run
+
 /*================================================================================*
   SETUP TIMER
  *================================================================================*/
@@ -175,6 +295,8 @@ void setup()
 /*-----------------------------------------*
   - hardware setup -
  *-----------------------------------------*/
+  tb_begin();
+
   pinMode(STATUS_LED_R, OUTPUT);
   pinMode(STATUS_LED_B, OUTPUT);
   pinMode(STATUS_LED_G, OUTPUT);
@@ -195,6 +317,7 @@ void setup()
     pinMode(LANE_DET[n], INPUT);
     digitalWrite(LANE_DET[n], HIGH);   // enable pull-up resistor
   }
+  lane_map(LANE_DET, NUM_LANES);       // lane -> (port, bit) for snapshots
 
   #ifdef ENABLE_DISPLAYS
   set_display_brightness();
@@ -203,36 +326,145 @@ void setup()
 /*-----------------------------------------*
   - software setup -
  *-----------------------------------------*/
-  Serial.begin(9600);
+  Serial.begin(SERIAL_BAUD);
+  cmd_begin(SMSG_ARGS);
   smsg(SMSG_POWER);
 
-  #ifdef ENABLE_DISPLAYS
-    setup_displays();
+  unmask_all_lanes();
+  clear_profile();
+  hist_begin(NUM_LANES);
+  restore_race_state();
 
-    //show Pack number for a few seconds at startup
-    for (int i=0; i<NUM_MATRICES;i=i+NUM_LANES) {
-      for (int n=0;n<NUM_LANES;n++) {
-        showChar(i+n, packnum[NUM_LANES-n-1]); //display in reverse
-      }
+#ifdef FAST_BOOT
+  boot_done();                         // timer first, then the displays
+
+  #ifdef ENABLE_DISPLAYS
+    setup_displays();                  // lane numbers, then the pack number (boot_task)
+    if (cold_start()) {
+      task_after(boot_task, 5000);
+    } else {
+      clear_displays();                // warm reset: no banner
     }
+  #endif
+#else
+  mode = mBOOT;
 
-    delay(4000);  //was 10000
+  #ifdef ENABLE_DISPLAYS
+    setup_displays();                  // lane numbers, then the pack number (boot_task)
+    task_after(boot_task, 5000);
+  #else
+    boot_done();
   #endif
+#endif
+
+#ifdef WATCHDOG
+  wdt_enable(WATCHDOG);
+#endif
+}
+
+
+/*================================================================================*
+  START-UP BANNER (task)
+ *================================================================================*/
+void boot_task()
+{
+  static boolean pack_shown = false;
+
+
+#ifdef FAST_BOOT
+  if (mode != mREADY) return;    // a race or test has the displays
+#else
+  if (mode != mBOOT) return;    // reset from the computer
+#endif
+
+  if (!pack_shown)    //show Pack number for a few seconds at startup
+  {
+    show_pack_number();
+    pack_shown = true;
+    task_after(boot_task, 4000);  //was 10000
+    return;
+  }
 
+#ifdef FAST_BOOT
+  clear_displays();    // back to the ready display
+#else
+  boot_done();
+#endif
+}
+
+
+void boot_done()
+{
 /*-----------------------------------------*
   - check for test mode -
  *-----------------------------------------*/
   if (digitalRead(RESET_SWITCH) == LOW)
   {
     mode = mTEST;
-    test_pdt_hw();
+    test_pdt_hw();    // initializes the timer when done
+    return;
+  }
+
+/*-----------------------------------------*
+  - back to the results if the host had not reset -
+ *-----------------------------------------*/
+  if (results_held)
+  {
+    resume_heat();
+    return;
   }
 
 /*-----------------------------------------*
   - initialize timer -
  *-----------------------------------------*/
   initialize(true);
-  unmask_all_lanes();
+}
+
+
+/*================================================================================*
+  RESTORE RACE STATE SAVED BEFORE A RESET
+
+  After a warm reset the RAM copy has everything, masks included. After a
+  power-on only EEPROM is left: the heat comes back if its results were
+  still held, otherwise just the sequence number and all lanes start
+  unmasked as before.
+ *================================================================================*/
+void restore_race_state()
+{
+  unsigned long hist_time[MAX_LANE];
+  int           hist_place[MAX_LANE];
+  boolean       hist_mask[MAX_LANE];
+
+
+  heat_restored = restore_heat(!cold_start(), &heat_seq, NUM_LANES, lane_time, lane_place, lane_mask, &results_held);
+
+  if (heat_restored == SAVE_EEPROM && !results_held) unmask_all_lanes();
+
+  if (results_held && !hist_get(heat_seq, hist_time, hist_place, hist_mask))    // reset before it reached EEPROM
+  {
+    hist_add(heat_seq, lane_time, lane_place, lane_mask);
+  }
+
+  return;
+}
+
+
+void save_race_state()
+{
+  save_heat(heat_seq, NUM_LANES, lane_time, lane_place, lane_mask, results_held);
+}
+
+
+void resume_heat()
+{
+  mode = mFINISH;
+  ready_first  = true;
+  finish_first = true;
+
+  boot_ready_us = micros();
+  dbg(fDebug, F("resume heat = "), heat_seq);
+
+  return;
 }
 
 
@@ -241,7 +473,18 @@ void setup()
  *================================================================================*/
 void loop()
 {
+  wdt_reset();
   process_general_msgs();
+  task_run();
+#ifdef LED_DISPLAY
+  service_displays();                  // send one queued display write
+#elif MATRIX_DISPLAY
+  flush_display_row();                 // send one changed matrix row
+#endif
+  if (!hist_service())                 // copy the heat history to EEPROM, a byte at a time, ahead of
+  {                                    // the saved heat (mask and reset saves would keep it waiting)
+    save_service();
+  }
 
   switch (mode)
   {
@@ -265,8 +508,10 @@ void timer_ready_state()
 {
   if (ready_first)
   {
+    gate_arm(START_GATE, START_TRIP);    // gate trip is timestamped by interrupt
+
     set_status_led();
-    clear_displays();
+    if (!task_pending(boot_task)) clear_displays();    // banner clears when done
 
     ready_first = false;
   }
@@ -278,16 +523,15 @@ void timer_ready_state()
   }
   #endif
   
-  if (digitalRead(START_GATE) == START_TRIP)    // timer start
+  if (gate_read(&start_time))    // timer start
   {
-    start_time = micros();
+    gate_disarm();
 
     #ifndef MATRIX_DISPLAY
     digitalWrite(START_SOL, LOW);
     #endif
 
     smsg(SMSG_START);
-    delay(100); 
 
     mode = mRACING; 
   }
@@ -301,81 +545,158 @@ void timer_ready_state()
  *================================================================================*/
 void timer_racing_state()
 {
-  int lanes_left, finish_order, lane_status[NUM_LANES];
-  unsigned long current_time, last_finish_time;
+  int reset_switch;
+  unsigned int lanes;
+  unsigned long current_time, last_edge;
+#ifdef ENABLE_TIMEOUT
+  unsigned long now;
+#endif
 
 
-  set_status_led();
-  clear_displays();
+  task_cancel(photo_task);             // previous heat's edges stop here at the latest
+  task_cancel(photo_send_task);
+  capture_begin(GLITCH_US * TB_TICKS_PER_US, fPhoto);    // finish edges are timestamped by interrupt
 
-  finish_order = 0;
-  last_finish_time = 0;
+  set_status_led();
+  clear_displays();                      // drawn now, written by schedule_displays()
 
-  lanes_left = NUM_LANES;
-  for (int n=0; n<NUM_LANES; n++)
-  {
-    if (lane_mask[n]) lanes_left--;
-  }
+  last_edge = 0;
+  race.start(start_time);
 
-  while (lanes_left)
+  while (race.running())
   {
-    current_time = micros();
-
-    for (int n=0; n<NUM_LANES; n++) lane_status[n] = bitRead(PIND, LANE_DET[n]);    // read status of all lanes
+    PROF_START(t_loop);
+    wdt_reset();
+#ifdef ENABLE_TIMEOUT
+    now = tb_ticks();                  // before the drain: any edge stamped by then is in the ring or held
+#endif
 
-    for (int n=0; n<NUM_LANES; n++)
+    while (capture_read(&lanes, &current_time))    // cars have crossed finish line (bit per lane)
     {
-      if (lane_time[n] == 0 && lane_status[n] == HIGH && !lane_mask[n])    // car has crossed finish line
-      {
-        lanes_left--;
-
-        lane_time[n] = current_time - start_time;
-
-        if (lane_time[n] > last_finish_time)
-        {
-          finish_order++;
-          last_finish_time = lane_time[n];
-        }
-        lane_place[n] = finish_order;
+      if (race.finish(lanes, current_time)) last_edge = current_time;
+    }
 
-        update_display(n, lane_place[n], lane_time[n], SHOW_PLACE);
-      } 
 #ifdef ENABLE_TIMEOUT
-      else if (lane_time[n] == 0 && !lane_mask[n] && current_time > (start_time + (NULL_TIME * 1000000.0)) )    //lane timeout
-      {
-        lanes_left--;
-        
-        lane_time[n] = NULL_TIME * 1000000.0;
-        if (lane_time[n] > last_finish_time)
-        {
-          finish_order++;
-          last_finish_time = lane_time[n];
-        }
-        lane_place[n] = finish_order;        
-        dbg(fDebug, "Timeout lane: ", n+1);
-        
-        update_display(n, lane_place[n], lane_time[n], SHOW_PLACE);
-      }
+    race.check_timeout(now);           // lane timeout (NULL_TICKS unless adaptive)
 #endif
-    }
-    
+
+    PROF_START(t_service);
+    schedule_displays(last_edge, race.running());
+    PROF_END(PROF_SERVICE, t_service);
+
+
+    PROF_START(t_serial);
     serial_data = get_serial_data();
+    PROF_END(PROF_SERIAL, t_serial);
+
+    PROF_START(t_switch);
+    reset_switch = digitalRead(RESET_SWITCH);
+    PROF_END(PROF_SWITCH, t_switch);
 
-    if (serial_data == int(SMSG_FORCE) || serial_data == int(SMSG_RESET) || digitalRead(RESET_SWITCH) == LOW)    // force race to end
+    if (serial_data == int(SMSG_FORCE) || serial_data == int(SMSG_RESET) || reset_switch == LOW)    // force race to end
     {
-      lanes_left = 0;
+      race.end();
       smsg(SMSG_ACKNW);
     }
+
+    PROF_END(PROF_LOOP, t_loop);
   }
-    
+
+  capture_end();
+  if (fPhoto) task_after(photo_task, PHOTO_TAIL);    // lanes stay watched for the last car's restore
+  photo_start = start_time;
+
+#ifdef ENABLE_TIMEOUT
+  update_spread(race.leader(), race.last_finish());
+#endif
+
+  heat_seq++;
   send_race_results();
 
+  results_held = true;
+  save_race_state();    // survives a reset until the host resets the timer
+  hist_add(heat_seq, lane_time, lane_place, lane_mask);
+
   mode = mFINISH;
 
   return;
 }
 
 
+/*-----------------------------------------*
+  - lane finished or timed out (race engine) -
+ *-----------------------------------------*/
+void Race::lane_done(byte lane, boolean timeout)
+{
+  if (timeout) dbg(fDebug, F("Timeout lane: "), lane+1);
+
+  PROF_START(t_update);
+  update_display(lane, lane_place[lane], lane_time[lane], SHOW_PLACE);
+  PROF_END(PROF_UPDATE, t_update);
+
+  return;
+}
+
+
+/*================================================================================*
+  ADAPTIVE HEAT TIMEOUT
+
+  Once the winner is in, a lane that is still out at the cutoff is given
+  NULL_TIME, as at the fixed timeout, so a stuck or derailed car does not
+  hold the track for the full NULL_TIME. The cutoff is a multiple of the
+  winner's time (tmLEADER), or the winner's time plus a multiple of the
+  session's mean spread from winner to last car (tmSPREAD), never less
+  than DNF_MIN after the winner and never past NULL_TIME.
+ *================================================================================*/
+unsigned long heat_cutoff(unsigned long leader)
+{
+  unsigned long cut;
+
+
+  if (timeout_mode == tmLEADER)
+  {
+    cut = leader / 10 * dnf_factor;
+  }
+  else if (timeout_mode == tmSPREAD && spread_avg)
+  {
+    cut = leader + spread_avg / 10 * dnf_factor;
+  }
+  else
+  {
+    return NULL_TICKS;
+  }
+
+  cut = max(cut, leader + DNF_MIN * (TB_TICKS_PER_SEC / 1000));
+
+  return min(cut, (unsigned long)NULL_TICKS);
+}
+
+
+/*-----------------------------------------*
+  - session spread (heats where every car finished) -
+ *-----------------------------------------*/
+void update_spread(unsigned long leader, unsigned long last)
+{
+  for (int n=0; n<NUM_LANES; n++)
+  {
+    if (!lane_mask[n] && (lane_time[n] == 0 || lane_time[n] >= NULL_TICKS)) return;    // DNF or forced end
+  }
+  if (!leader) return;
+
+  if (!spread_avg)
+  {
+    spread_avg = last - leader;
+  }
+  else
+  {
+    spread_avg = spread_avg - spread_avg / 8 + (last - leader) / 8;    // rolling mean, 1/8 weight
+  }
+  spread_avg = max(spread_avg, 1UL);    // 0 = no heats yet
+
+  return;
+}
+
+
 /*================================================================================*
   TIMER FINISHED STATE
  *================================================================================*/
@@ -384,20 +705,29 @@ void timer_finished_state()
   if (finish_first)
   {
     set_status_led();
+    track_clear_ms = millis();
     finish_first = false;
   }
 
-  if (GATE_RESET && digitalRead(START_GATE) != START_TRIP)    // gate closed
+  if (GATE_RESET && digitalRead(START_GATE) != START_TRIP && !task_pending(gate_reset_task))    // gate closed
   {
-    delay(500);    // ignore any switch bounce
+    task_after(gate_reset_task, 500);    // ignore any switch bounce
+  } 
 
-    if (digitalRead(START_GATE) != START_TRIP)    // gate still closed
+  if (fAuto)    // continuous heats: rearm once the track has stayed clear
+  {
+    if (!track_clear())
     {
-      initialize();    // reset timer
-    } 
-  } 
+      track_clear_ms = millis();
+    }
+    else if (millis() - track_clear_ms >= REARM_CLEAR)
+    {
+      initialize();
+      return;
+    }
+  }
 
-  if (serial_data == int(SMSG_RSEND))    // resend race data
+  if (serial_data == int(SMSG_RSEND) && !cmd.argc)    // resend race data
   {
       smsg(SMSG_ACKNW);
       send_race_results();
@@ -418,32 +748,66 @@ void timer_finished_state()
 void process_general_msgs()
 {
   int lane;
-  char tmps[50];
+  char tmps[64];
+  boolean reset_low, reset_press;
+  static boolean reset_down = false;
 
 
   serial_data = get_serial_data();
 
+  reset_low   = (digitalRead(RESET_SWITCH) == LOW);
+  reset_press = reset_low && !reset_down;    // act once per press
+  reset_down  = reset_low;
+
   if (serial_data == int(SMSG_GVERS))    // get software version
   {
-      sprintf(tmps, "vert=%s", PDT_VERSION);
+      sprintf_P(tmps, PSTR("vert=%s"), PDT_VERSION);
       smsg_str(tmps);
   } 
 
   else if (serial_data == int(SMSG_GNUML))    // get number of lanes
   {
-      sprintf(tmps, "numl=%d", NUM_LANES);
+      sprintf_P(tmps, PSTR("numl=%d"), NUM_LANES);
       smsg_str(tmps);
   } 
 
+  else if (serial_data == int(SMSG_GLTCH))    // get glitch counts
+  {
+      strcpy_P(tmps, PSTR("glch="));
+      for (int n=0; n<NUM_LANES; n++)
+      {
+        sprintf(tmps + strlen(tmps), n ? ",%u" : "%u", capture_glitches(n));
+      }
+      smsg_str(tmps);
+  }
+
+  else if (serial_data == int(SMSG_PHOTO))    // photo finish
+  {
+    if (cmd.argc && cmd.argv[0] <= 1)
+    {
+      fPhoto = (cmd.argv[0] == 1);
+      smsg(SMSG_ACKNW);
+    }
+    else
+    {
+      send_photo_data();
+    }
+  }
+
   else if (serial_data == int(SMSG_TINFO))    // get timer information
   {
       send_timer_info();
   } 
 
+  else if (serial_data == int(SMSG_PROF))    // get racing loop profile
+  {
+      send_profile();
+  } 
+
   else if (serial_data == int(SMSG_DEBUG))    // toggle debug
   {
     fDebug = !fDebug;
-    dbg(true, "toggle debug = ", fDebug);
+    dbg(true, F("toggle debug = "), fDebug);
   } 
 
   else if (serial_data == int(SMSG_CGATE))    // check start gate
@@ -458,9 +822,9 @@ void process_general_msgs()
     } 
   } 
 
-  else if (serial_data == int(SMSG_RESET) || digitalRead(RESET_SWITCH) == LOW)    // timer reset
+  else if (serial_data == int(SMSG_RESET) || (reset_press && mode != mTEST && mode != mBOOT))    // timer reset (test modes own the switch)
   {
-    if (digitalRead(START_GATE) != START_TRIP)    // only reset if gate closed
+    if (digitalRead(START_GATE) != START_TRIP || mode == mTEST)    // only reset if gate closed
     {
       initialize();
     } 
@@ -470,36 +834,84 @@ void process_general_msgs()
     } 
   } 
 
-  else if (serial_data == int(SMSG_LMASK))    // lane mask
+  else if (serial_data == int(SMSG_RSEND) && cmd.argc)    // resend heats from history
   {
-    delay(100);
-    serial_data = get_serial_data();
+    if (cmd.argv[0] > 0xFFFFL || cmd.argv[cmd.argc > 1 ? 1 : 0] > 0xFFFFL)    // heat IDs are 16 bits
+    {
+      smsg(SMSG_CMDER);
+    }
+    else
+    {
+      dump_history(cmd.argv[0], cmd.argv[cmd.argc > 1 ? 1 : 0]);
+    }
+  }
+
+  else if (serial_data == int(SMSG_LMASK))    // lane mask (one or more lanes)
+  {
+    for (int i=0; i<cmd.argc; i++)
+    {
+      if (cmd.argv[i] >= 1 && cmd.argv[i] <= NUM_LANES)    // checked before it is narrowed to an int
+      {
+        lane = cmd.argv[i];
+        lane_mask[lane-1] = true;
+
+        dbg(fDebug, F("set mask on lane = "), lane);
+      }
+    }
+    save_race_state();
+    smsg(SMSG_ACKNW);
+  }
+
+  else if (serial_data == int(SMSG_SBAUD))    // set serial baud
+  {
+    set_serial_baud(cmd.argc ? cmd.argv[0] : -1);
+  }
+
+  else if (serial_data == int(SMSG_RFMT))    // result format
+  {
+    if (cmd.argc && cmd.argv[0] <= 1)
+    {
+      fBinary = (cmd.argv[0] == 1);
+    }
+    smsg(SMSG_ACKNW);
+  }
 
-    lane = serial_data - 48;
-    if (lane >= 1 && lane <= NUM_LANES)
+  else if (serial_data == int(SMSG_TMOUT))    // heat timeout mode
+  {
+    if (cmd.argc && cmd.argv[0] <= tmSPREAD)
     {
-      lane_mask[lane-1] = true;
+      timeout_mode = cmd.argv[0];
+      dnf_factor = timeout_mode == tmSPREAD ? DNF_SPREAD : DNF_LEADER;
+      if (cmd.argc > 1) dnf_factor = max(10L, min(cmd.argv[1], 255L));
+    }
+    smsg(SMSG_ACKNW);
+  }
 
-      dbg(fDebug, "set mask on lane = ", lane);
+  else if (serial_data == int(SMSG_AUTO))    // continuous heats
+  {
+    if (cmd.argc && cmd.argv[0] <= 1)
+    {
+      fAuto = (cmd.argv[0] == 1);
+      track_clear_ms = millis();
     }
     smsg(SMSG_ACKNW);
   }
 
+  else if (serial_data == int(CMD_BAD))    // framed command did not parse
+  {
+    smsg(SMSG_CMDER);
+  }
+
   else if (serial_data == int(SMSG_UMASK))    // unmask all lanes
   {
     unmask_all_lanes();
+    save_race_state();
     smsg(SMSG_ACKNW);
   }
 
   else if (serial_data == int(SMSG_PACK)) //show pack number on displays
   {
-    //show Pack number for a few seconds at startup
-    for (int i=0; i<NUM_MATRICES;i=i+NUM_LANES) {
-      for (int n=0;n<NUM_LANES;n++) {
-        showChar(i+n, packnum[NUM_LANES-n-1]); //display in reverse
-      }
-    }
-  
+    show_pack_number();
   }
 
   else if (serial_data == int(SMSG_LANES)) //show lane numbers on displays
@@ -515,7 +927,6 @@ void process_general_msgs()
         showChar(NUM_LANES+n, (char)48+NUM_LANES-n); //reverse order
       }
     }
- 
   }
 
    else if (serial_data == int(SMSG_CHECK)) //start lane sensor check
@@ -531,24 +942,39 @@ void process_general_msgs()
 
 /*================================================================================*
   TEST PDT FINISH DETECTION HARDWARE
+
+  Runs as a task: the lane detectors, then the start gate, then the
+  brightness pattern, each until the reset switch is pressed.
  *================================================================================*/
 void test_pdt_hw()
 {
-  int  lane_status[NUM_LANES];
-
   smsg_str("TEST MODE");
   set_status_led();
-  delay(2000); 
 
   #ifdef ENABLE_DISPLAYS
     set_display_brightness();
   #endif
+
+  test_step = 0;
+  task_after(test_task, 2000);
+}
+
+
+void test_task()
+{
+  int  lane_status[NUM_LANES];
+  unsigned int states;
+
+
+  if (mode != mTEST) return;    // reset from the computer
+
 /*-----------------------------------------*
    show status of lane detectors
  *-----------------------------------------*/
-  while(true) {
+  if (test_step == 0) {
+    states = lane_states();    // read status of all lanes
     for (int n=0; n<NUM_LANES; n++) {
-      lane_status[n] = bitRead(PIND, LANE_DET[n]);    // read status of all lanes
+      lane_status[n] = bitRead(states, n);
 #ifndef MATRIX_DISPLAY
       if (lane_status[n] == HIGH) {
         update_display(n, msgDark);
@@ -563,21 +989,12 @@ void test_pdt_hw()
       }
   #endif
     }
-
-    if (digitalRead(RESET_SWITCH) == LOW)  // break out of this test
-    {
-      clear_displays();
-      delay(1000); 
-      break;
-    }
-    delay(100);
   }
 
 /*-----------------------------------------*
    show status of start gate switch
  *-----------------------------------------*/
-  while(true)
-  {
+  else if (test_step == 1) {
 #ifndef MATRIX_DISPLAY
     if (digitalRead(START_GATE) == START_TRIP) 
     {
@@ -594,29 +1011,27 @@ void test_pdt_hw()
       showChar(0, '-');
     }
 #endif
-    if (digitalRead(RESET_SWITCH) == LOW)  // break out of this test
-    {
-      clear_displays();
-      delay(1000); 
-      break;
-    }
-    delay(100);
   }
 
 /*-----------------------------------------*
    show pattern for brightness adjustment
  *-----------------------------------------*/
-  while(true)  {
+  else {
     set_display_brightness();
-    show_brightness_pattern(display_level);
+    show_brightness_pattern(display_level / 10);
+  }
 
-    if (digitalRead(RESET_SWITCH) == LOW)  // break out of this test
-    {
-      clear_displays();
-      break;
+  if (digitalRead(RESET_SWITCH) == LOW)  // on to the next test
+  {
+    clear_displays();
+    if (++test_step > 2) {
+      initialize(true);
+      return;
     }
-    delay(1000);
+    task_after(test_task, 1000);
+    return;
   }
+  task_after(test_task, test_step < 2 ? 100 : 1000);
 }
 
 
@@ -624,48 +1039,53 @@ void test_pdt_hw()
    show status of lane detectors
  *-----------------------------------------*/
 void check_lane_sensors() {
-  int  lane_status[NUM_LANES];
-  
   //smsg_str("LANE CHECK MODE");
   set_status_led();
-  delay(2000);
   #ifdef ENABLE_DISPLAYS
   set_display_brightness(); //for good measure - some cases the brightness change isn't seen by displays
   #endif
 
-  while(true) {
-    for (int n=0; n<NUM_LANES; n++) {
-      lane_status[n] = bitRead(PIND, LANE_DET[n]);    // read status of all lanes
-#ifndef MATRIX_DISPLAY
-      if (lane_status[n] == HIGH) {
-        update_display(n, msgDark);
-      } else {
-        update_display(n, msgLight);
-      }
-  #else
-      if (lane_status[n] == HIGH) {
-        showChar(n, '+');
-        if (NUM_MATRICES==8) { //show on both sides
-          showChar(7-n, '+');
-        }
-      } else {
-        showChar(n, 'O');
-        if (NUM_MATRICES==8) { //show on both sides
-          showChar(7-n, 'O');
-        }
-      }
-  #endif
-    }
+  task_after(lane_check_task, 2000);
+}
 
-    serial_data = get_serial_data();
 
-    if (serial_data == int(SMSG_RESET) || digitalRead(RESET_SWITCH) == LOW) {
-      initialize(); //perform an actual reset
-      break;
+void lane_check_task() {
+  int  lane_status[NUM_LANES];
+  unsigned int states;
+
+
+  if (mode != mTEST) return;    // reset from the computer
+
+  states = lane_states();    // read status of all lanes
+  for (int n=0; n<NUM_LANES; n++) {
+    lane_status[n] = bitRead(states, n);
+#ifndef MATRIX_DISPLAY
+    if (lane_status[n] == HIGH) {
+      update_display(n, msgDark);
+    } else {
+      update_display(n, msgLight);
+    }
+  #else
+    if (lane_status[n] == HIGH) {
+      showChar(n, '+');
+      if (NUM_MATRICES==8) { //show on both sides
+        showChar(7-n, '+');
+      }
+    } else {
+      showChar(n, 'O');
+      if (NUM_MATRICES==8) { //show on both sides
+        showChar(7-n, 'O');
+      }
     }
+  #endif
+  }
 
-    delay(100);
+  if (digitalRead(RESET_SWITCH) == LOW) {
+    initialize(); //perform an actual reset
+    return;
   }
+
+  task_after(lane_check_task, 100);
 }
 
 /*================================================================================*
@@ -673,28 +1093,275 @@ void check_lane_sensors() {
  *================================================================================*/
 void send_race_results()
 {
-  float lane_time_sec;
+  send_heat(heat_seq, lane_time, lane_place, lane_mask, fAuto);    // continuous heats carry their ID
+}
+
+
+/*================================================================================*
+  SEND HEAT RESULTS (id_line puts "heat=<id>" before text results)
+ *================================================================================*/
+void send_heat(unsigned int seq, const unsigned long time[], const int place[], const boolean mask[], boolean id_line)
+{
+  char ctime[12];
+  char rbuf[16 + NUM_LANES * 16];    // "n - s.ffff\r\n" per lane
+  int len = 0;
+
 
+  if (fBinary)
+  {
+    send_result_frame(seq, time, place, mask);
+    return;
+  }
+
+  if (id_line) len += sprintf_P(rbuf, PSTR("heat=%u\r\n"), seq);
 
   for (int n=0; n<NUM_LANES; n++)    // send times to computer
   {
-    lane_time_sec = (float)(lane_time[n] / 1000000.0);    // elapsed time (seconds)
+    if (time[n] == 0)    // did not finish
+    {
+      tb_format(ctime, NULL_TICKS, NUM_DIGIT);
+    }
+    else
+    {
+      tb_format(ctime, time[n], NUM_DIGIT);    // rounded to NUM_DIGIT digits
+    }
+
+    len += sprintf_P(rbuf + len, PSTR("%d - %s\r\n"), n+1, ctime);
+  }
+
+  Serial.write((const uint8_t *)rbuf, len);    // one write (fits the 64 byte TX buffer for 4 lanes)
+
+  return;
+}
+
+
+/*================================================================================*
+  RESEND HEATS FROM HISTORY
+
+  Each heat held from first to last goes out as it would have at the end
+  of its race, text results after a "heat=<id>" line or a binary frame
+  with the heat ID as its sequence number, then SMSG_ACKNW ends the dump.
+  One heat is sent per pass of loop() once the TX buffer has room, so a
+  long dump never holds up the loop.
+ *================================================================================*/
+void dump_history(unsigned int first, unsigned int last)
+{
+  unsigned int held_first, held_last;
+
+
+  dump_left = 0;
+  if (hist_range(&held_first, &held_last))
+  {
+    if ((int16_t)(first - held_first) < 0) first = held_first;    // only ask for what is held
+    if ((int16_t)(last - held_last) > 0) last = held_last;
+    if ((int16_t)(last - first) >= 0) dump_left = (uint16_t)(last - first) + 1;
+  }
+  dump_next = first;
+
+  task_after(dump_task, 0);
+
+  return;
+}
+
+
+void dump_task()
+{
+  unsigned long time[MAX_LANE];
+  int           place[MAX_LANE];
+  boolean       mask[MAX_LANE];
+
+
+  if (Serial.availableForWrite() < DUMP_ROOM)    // previous heat still going out
+  {
+    task_after(dump_task, 0);
+    return;
+  }
 
-    if (lane_time_sec == 0)    // did not finish
+  while (dump_left)
+  {
+    dump_left--;
+    if (hist_get(dump_next++, time, place, mask))
     {
-      lane_time_sec = NULL_TIME;
+      send_heat(dump_next - 1, time, place, mask, true);
+      task_after(dump_task, 0);
+      return;
     }
+  }
+
+  smsg(SMSG_ACKNW);
+
+  return;
+}
+
+
+/*================================================================================*
+  PHOTO FINISH (see photo_functions.cpp)
+
+  With fPhoto set, each heat's lane edges are kept until the next heat
+  starts. PHOTO_TAIL after the heat the lanes stop being watched and the
+  heat is added to the lane alignment. SMSG_PHOTO with no digit sends,
+  per lane, the derived pass and the edges themselves (usecs from the
+  start), a line per pass of loop() once the TX buffer has room:
+    phot=<lane>,<edges>,<breaks>,<usecs in beam>,<midpoint usecs>,<speed mm/s>
+    edge=<lane>,<break>,<restore>,<break>...
+  <edges> counts every edge seen; edge= lists only the first PHOTO_EDGES.
+ *================================================================================*/
+void photo_data(int lane, photo_lane *pl)
+{
+  unsigned long edge[PHOTO_EDGES];
+  byte count = lane_mask[lane] ? 0 : photo_edges(lane, edge);
+
+
+  photo_lane_data(edge, count, photo_start, GLITCH_US * TB_TICKS_PER_US, CAR_MM, pl);
+
+  return;
+}
+
+
+void photo_task()
+{
+  photo_lane pl[NUM_LANES];
+
+
+  photo_end();
+  for (int n=0; n<NUM_LANES; n++) photo_data(n, &pl[n]);
+  photo_heat(pl, NUM_LANES);
+
+  return;
+}
+
+
+void send_photo_data()
+{
+  photo_line = 0;
+  task_after(photo_send_task, 0);
+
+  return;
+}
+
+
+void photo_send_task()
+{
+  photo_lane pl;
+  unsigned long edge[PHOTO_EDGES];
+  char tmps[64];
+  int lane = photo_line / 2;
+  byte count;
 
-    Serial.print(n+1);
-    Serial.print(" - ");
-    Serial.println(lane_time_sec, NUM_DIGIT);  // numbers are rounded to NUM_DIGIT
-                                               // digits by println function
+
+  if (Serial.availableForWrite() < DUMP_ROOM)    // previous line still going out
+  {
+    task_after(photo_send_task, 0);
+    return;
   }
 
+  if (photo_line % 2 == 0)
+  {
+    photo_data(lane, &pl);
+    sprintf_P(tmps, PSTR("phot=%d,%d,%d,%lu,%lu,%lu"), lane+1, pl.edges, pl.breaks, pl.blocked / TB_TICKS_PER_US,
+              pl.mid / TB_TICKS_PER_US, pl.speed);
+  }
+  else
+  {
+    count = lane_mask[lane] ? 0 : min(photo_edges(lane, edge), (byte)PHOTO_EDGES);
+    sprintf_P(tmps, PSTR("edge=%d"), lane+1);
+    for (byte i=0; i<count; i++)
+    {
+      sprintf_P(tmps + strlen(tmps), PSTR(",%lu"), (edge[i] - photo_start) / TB_TICKS_PER_US);
+    }
+  }
+  smsg_str(tmps);
+
+  if (++photo_line < 2 * NUM_LANES) task_after(photo_send_task, 0);
+
   return;
 }
 
 
+/*================================================================================*
+  SEND RACE RESULTS AS BINARY FRAME (see frame_functions.h)
+
+  Raw ticks are sent, so the host gets the full timebase resolution. A
+  resent frame keeps its sequence number.
+ *================================================================================*/
+void send_result_frame(unsigned int seq, const unsigned long time[], const int place[], const boolean mask[])
+{
+  byte fbuf[FRAME_SIZE(NUM_LANES)];
+  byte mask_bits = 0, dnf_bits = 0;
+  int len;
+
+
+  for (int n=0; n<NUM_LANES; n++)
+  {
+    if (mask[n])
+    {
+      mask_bits |= _BV(n);
+    }
+    else if (time[n] == 0 || time[n] >= NULL_TICKS)    // forced end or timeout
+    {
+      dnf_bits |= _BV(n);
+    }
+  }
+
+  len = frame_encode(fbuf, seq, NUM_LANES, time, place, mask_bits, dnf_bits);
+  Serial.write(fbuf, len);
+
+  return;
+}
+
+
+/*================================================================================*
+  SET SERIAL BAUD
+
+  The reply is sent at the current baud, then the UART switches. The host
+  must send SMSG_SBAUD again at the new baud within BAUD_CONFIRM, or the
+  timer goes back to the old baud so a host that missed the switch is not
+  locked out. Power-up is always SERIAL_BAUD.
+ *================================================================================*/
+void set_serial_baud(long code)
+{
+  char tmps[20];
+
+
+  if (task_pending(baud_switch_task)) return;    // reply still going out
+
+  if (task_pending(baud_revert_task))    // host confirmed at the new baud
+  {
+    task_cancel(baud_revert_task);
+    dbg(fDebug, F("baud confirmed"));
+  }
+  else
+  {
+    baud_prev = serial_baud;
+    if (code >= 0 && code < (long)NUM_BAUD)    // checked as a long: <X65537> is not code 1
+    {
+      serial_baud = BAUD_RATE[code];
+    }
+    if (serial_baud != baud_prev) task_after(baud_switch_task, BAUD_DRAIN);
+  }
+
+  sprintf_P(tmps, PSTR("baud=%lu"), serial_baud);
+  smsg_str(tmps);
+
+  return;
+}
+
+
+void baud_switch_task()
+{
+  Serial.flush();    // finish the reply at the old baud
+  Serial.begin(serial_baud);
+  task_after(baud_revert_task, BAUD_CONFIRM);
+}
+
+
+void baud_revert_task()
+{
+  serial_baud = baud_prev;
+  Serial.begin(serial_baud);
+}
+
+
 /*================================================================================*
   RACE FINISHED - DISPLAY PLACE / TIME FOR ALL LANES
  *================================================================================*/
@@ -717,7 +1384,7 @@ void display_race_results()
 
   if ((now - last_display_update) > (unsigned long)(PLACE_DELAY * 1000))
   {
-    dbg(fDebug, "display_race_results");
+    dbg(fDebug, F("display_race_results"));
 
     for (int n=0; n<NUM_LANES; n++)
     {
@@ -737,14 +1404,15 @@ void display_race_results()
  *================================================================================*/
 void update_display(int lane, int display_place, unsigned long display_time, int display_mode)
 {
-  dbg(fDebug, "led: lane = ", lane);
-  dbg(fDebug, "led: plce = ", display_place);
-  dbg(fDebug, "led: time = ", display_time);
+  unsigned long t0 = micros();
+
+  dbg(fDebug, F("led: lane = "), lane);
+  dbg(fDebug, F("led: plce = "), display_place);
+  dbg(fDebug, F("led: time = "), display_time);
 
 #ifdef LED_DISPLAY
   int c;
-  char ctime[10], cplace[4];
-  double display_time_sec;
+  char ctime[12], cplace[4];
   boolean showdot;
 
 
@@ -752,18 +1420,18 @@ void update_display(int lane, int display_place, unsigned long display_time, int
   {
     if (display_place > 0)  // show place order
     {
-      sprintf(cplace,"%1d", display_place);
+      sprintf_P(cplace, PSTR("%1d"), display_place);
 
       disp_mat[lane].clear();
       disp_mat[lane].drawColon(false);
       disp_mat[lane].writeDigitNum(3, char2int(cplace[0]), false);
-      disp_mat[lane].writeDisplay();
+      queue_display(lane, true);
 
 #ifdef DUAL_DISP
       disp_mat[lane+4].clear();
       disp_mat[lane+4].drawColon(false);
       disp_mat[lane+4].writeDigitNum(3, char2int(cplace[0]), false);
-      disp_mat[lane+4].writeDisplay();
+      queue_display(lane+4, true);
 #endif
     }
     else  // did not finish
@@ -790,8 +1458,7 @@ void update_display(int lane, int display_place, unsigned long display_time, int
 #endif
 #endif
 
-      display_time_sec = (double)(display_time / (double)1000000.0);    // elapsed time (seconds)
-      dtostrf(display_time_sec, (DISP_DIGIT+1), DISP_DIGIT, ctime);     // convert to string
+      tb_format(ctime, display_time, DISP_DIGIT);    // elapsed time (seconds)
 
 //      Serial.print("ctime = ["); Serial.print(ctime); Serial.println("]");
       c = 0;
@@ -805,7 +1472,7 @@ void update_display(int lane, int display_place, unsigned long display_time, int
         disp_mat[lane].writeDigitNum(d + int(d / 2), char2int(ctime[c]), showdot);    // time
 #ifdef DUAL_DISP
 #ifdef DUAL_MODE
-        sprintf(cplace,"%1d", display_place);
+        sprintf_P(cplace, PSTR("%1d"), display_place);
         disp_8x8[lane+4].print(cplace[0]);
 #else
         disp_mat[lane+4].writeDigitNum(d + int(d / 2), char2int(ctime[c]), showdot);    // time
@@ -824,13 +1491,9 @@ void update_display(int lane, int display_place, unsigned long display_time, int
 #endif
 #endif
 
-      disp_mat[lane].writeDisplay();
+      queue_display(lane, true);
 #ifdef DUAL_DISP
-#ifdef DUAL_MODE
-      disp_8x8[lane+4].writeDisplay();
-#else
-      disp_mat[lane+4].writeDisplay();
-#endif
+      queue_display(lane+4, true);
 #endif
     }
     else  // did not finish
@@ -841,7 +1504,7 @@ void update_display(int lane, int display_place, unsigned long display_time, int
 #endif
 #ifdef MATRIX_DISPLAY
   char cplace[4];
-  sprintf(cplace,"%1d", display_place);
+  sprintf_P(cplace, PSTR("%1d"), display_place);
     if (display_place > 0) {  // show place order
       showChar(lane, cplace[0]);
       if (NUM_MATRICES==8) {
@@ -854,8 +1517,9 @@ void update_display(int lane, int display_place, unsigned long display_time, int
         showChar(7-lane, '-');
       }
     }
-
 #endif
+  disp_update_us = max(disp_update_us, micros() - t0);
+
   return;
 }
 
@@ -865,7 +1529,9 @@ void update_display(int lane, int display_place, unsigned long display_time, int
  *================================================================================*/
 void clear_displays()
 {
-  dbg(fDebug, "led: CLEAR");
+  unsigned long t0 = micros();
+
+  dbg(fDebug, F("led: CLEAR"));
 
   for (int n=0; n<NUM_MATRICES; n++) {
     if (mode == mRACING || mode == mTEST) {
@@ -884,6 +1550,38 @@ void clear_displays()
 #endif
     }
   }
+  disp_clear_us = max(disp_clear_us, micros() - t0);
+
+  return;
+}
+
+
+/*================================================================================*
+  SCHEDULE LANE DISPLAY WRITES (racing)
+
+  Lane displays are only drawn in RAM; outside a race loop() sends one slice
+  per pass. While racing the bus writes happen here, in slices (one matrix
+  row or one LED display) until DISP_BUDGET is used up,
+  so a pass of the racing loop never spends much more than that on displays.
+  Place/time writes go before blanking. After a finish the writes are held
+  for DISP_WINDOW while lanes remain, since the rest of the field is usually
+  only a few milliseconds behind.
+ *================================================================================*/
+void schedule_displays(unsigned long last_edge, int lanes_left)
+{
+  unsigned long t0 = tb_ticks();
+
+  if (!lanes_left) return;    // results go out first, the rest is flushed after
+  if (last_edge && (t0 - last_edge) < DISP_WINDOW * (TB_TICKS_PER_SEC / 1000)) return;
+
+  do
+  {
+#ifdef LED_DISPLAY
+    if (!service_displays()) break;
+#else
+    if (!flush_display_row()) break;
+#endif
+  } while ((tb_ticks() - t0) < DISP_BUDGET * TB_TICKS_PER_US);
 
   return;
 }
@@ -894,21 +1592,20 @@ void clear_displays()
  *================================================================================*/
 void set_display_brightness()
 {
+  int new_level;
 
-  float new_level;
-
-  new_level = long(1023 - analogRead(BRIGHT_LEV)) / 1023.0F * 15.0F;
-  new_level = min(new_level, (float)MAX_BRIGHT);
-  new_level = max(new_level, (float)MIN_BRIGHT);
+  new_level = long(1023 - analogRead(BRIGHT_LEV)) * 150 / 1023;    // tenths of a level
+  new_level = min(new_level, MAX_BRIGHT * 10);
+  new_level = max(new_level, MIN_BRIGHT * 10);
 
-  if (fabs(new_level - display_level) > 0.3F)    // deadband to prevent flickering 
-  {                                              // between levels
-    dbg(fDebug, "led: BRIGHT");
+  if (abs(new_level - display_level) > 3)    // deadband to prevent flickering 
+  {                                          // between levels
+    dbg(fDebug, F("led: BRIGHT"));
 
     display_level = new_level;
 
     #ifdef ENABLE_DISPLAYS
-      set_display_brightness(display_level);
+      set_display_brightness(display_level / 10);
     #endif
 
   }
@@ -924,7 +1621,7 @@ void set_status_led()
 {
   int r_lev, b_lev, g_lev;
 
-  dbg(fDebug, "status led = ", mode);
+  dbg(fDebug, F("status led = "), mode);
 
   r_lev = PWM_LED_OFF;
   b_lev = PWM_LED_OFF;
@@ -963,16 +1660,63 @@ int get_serial_data()
 {  
   int data = 0;
   
-  if (Serial.available() > 0)
+  if (cmd_read(&cmd))    // arguments are left in cmd
   {
-    data = Serial.read();
-    dbg(fDebug, "ser rec = ", data);
+    data = cmd.code;
+    dbg(fDebug, F("ser rec = "), data);
   }
 
   return data;
 }  
 
 
+/*================================================================================*
+  SHOW PACK NUMBER ON DISPLAYS
+ *================================================================================*/
+void show_pack_number()
+{
+  for (int i=0; i<NUM_MATRICES;i=i+NUM_LANES) {
+    for (int n=0;n<NUM_LANES;n++) {
+      showChar(i+n, packnum[NUM_LANES-n-1]); //display in reverse
+    }
+  }
+
+  return;
+}
+
+
+/*================================================================================*
+  TRACK CLEAR - GATE CLOSED AND NO CAR AT THE FINISH (masked lanes ignored)
+ *================================================================================*/
+boolean track_clear()
+{
+  unsigned int states;
+
+
+  if (digitalRead(START_GATE) == START_TRIP) return false;
+
+  states = lane_states();
+  for (int n=0; n<NUM_LANES; n++)
+  {
+    if (!lane_mask[n] && bitRead(states, n)) return false;    // beam blocked
+  }
+
+  return true;
+}
+
+
+/*================================================================================*
+  GATE CLOSED AFTER A RACE - RESET ONCE IT HAS SETTLED (task)
+ *================================================================================*/
+void gate_reset_task()
+{
+  if (mode == mFINISH && digitalRead(START_GATE) != START_TRIP)    // gate still closed
+  {
+    initialize();    // reset timer
+  }
+}
+
+
 /*================================================================================*
   INITIALIZE TIMER
  *================================================================================*/
@@ -1000,13 +1744,16 @@ void initialize(boolean powerup)
     mode = mREADY;
 
     smsg(SMSG_READY);
-    delay(100);
   }
-  Serial.flush();
 
   ready_first  = true;
   finish_first  = true;
 
+  results_held = false;
+  save_race_state();
+
+  if (powerup) boot_ready_us = micros();
+
   return;
 }
 
@@ -1016,7 +1763,7 @@ void initialize(boolean powerup)
  *================================================================================*/
 void unmask_all_lanes()
 {  
-  dbg(fDebug, "unmask all lanes");
+  dbg(fDebug, F("unmask all lanes"));
 
   for (int n=0; n<NUM_LANES; n++)
   {
@@ -1030,25 +1777,20 @@ void unmask_all_lanes()
 /*================================================================================*
   SEND DEBUG TO COMPUTER
  *================================================================================*/
-void dbg(int flag, const char * msg, int val)
+void dbg(int flag, const __FlashStringHelper * msg, int val)
 {  
-  char tmps[50];
+  char tmps[64];
+  int  len;
 
 
   if (!flag) return;
 
-  smsg_str("dbg: ", false);
-  smsg_str(msg, false);
-
-  if (val != -999)
-  {
-    sprintf(tmps, "%d", val);
-    smsg_str(tmps);
-  }
-  else
-  {
-    smsg_str("");
-  }
+  strcpy_P(tmps, PSTR("dbg: "));
+  strncat_P(tmps, (const char *)msg, sizeof(tmps) - 16);    // messages live in flash, F("...")
+  len = strlen(tmps);
+  if (val != -999) len += sprintf_P(tmps + len, PSTR("%d"), val);
+  strcpy_P(tmps + len, PSTR("\r\n"));
+  Serial.write((const uint8_t *)tmps, len + 2);    // one write per message
 
   return;
 }
@@ -1096,76 +1838,155 @@ void smsg_str(const char * msg, boolean crlf)
 void send_timer_info()
 {
   char tmps[50];
+  unsigned int first, last;
 
-  Serial.println("-----------------------------");
-  sprintf(tmps, " PDT            Version %s", PDT_VERSION);
+  Serial.println(F("-----------------------------"));
+  sprintf_P(tmps, PSTR(" PDT            Version %s"), PDT_VERSION);
   Serial.println(tmps);
-  Serial.println("-----------------------------");
+  Serial.println(F("-----------------------------"));
 
-  sprintf(tmps, "  NUM_LANES      %d", NUM_LANES);
+  sprintf_P(tmps, PSTR("  NUM_LANES      %d"), NUM_LANES);
   Serial.println(tmps);
-  sprintf(tmps, "  GATE_RESET     %d", GATE_RESET);
+  sprintf_P(tmps, PSTR("  GATE_RESET     %d"), GATE_RESET);
   Serial.println(tmps);
-  sprintf(tmps, "  SHOW_PLACE     %d", SHOW_PLACE);
+  sprintf_P(tmps, PSTR("  AUTO_REARM     %d"), fAuto);
   Serial.println(tmps);
-  sprintf(tmps, "  PLACE_DELAY    %d", PLACE_DELAY);
+  sprintf_P(tmps, PSTR("  SHOW_PLACE     %d"), SHOW_PLACE);
   Serial.println(tmps);
-  sprintf(tmps, "  MIN_BRIGHT     %d", MIN_BRIGHT);
+  sprintf_P(tmps, PSTR("  PLACE_DELAY    %d"), PLACE_DELAY);
   Serial.println(tmps);
-  sprintf(tmps, "  MAX_BRIGHT     %d", MAX_BRIGHT);
+  sprintf_P(tmps, PSTR("  MIN_BRIGHT     %d"), MIN_BRIGHT);
+  Serial.println(tmps);
+  sprintf_P(tmps, PSTR("  MAX_BRIGHT     %d"), MAX_BRIGHT);
   Serial.println(tmps);
 
-  Serial.println("");
+  Serial.println();
 
 #ifdef ENABLE_TIMEOUT
-  Serial.println("  ENABLE_TIMEOUT 1");
+  Serial.println(F("  ENABLE_TIMEOUT 1"));
+  sprintf_P(tmps, PSTR("  TIMEOUT MODE   %d x%d.%d"), timeout_mode, dnf_factor / 10, dnf_factor % 10);
+  Serial.println(tmps);
+  sprintf_P(tmps, PSTR("  SPREAD ms      %lu"), spread_avg / (TB_TICKS_PER_SEC / 1000));
+  Serial.println(tmps);
 #else
-  Serial.println("  ENABLE_TIMEOUT 0");
+  Serial.println(F("  ENABLE_TIMEOUT 0"));
+#endif
+  sprintf_P(tmps, PSTR("  GLITCH_US      %d"), GLITCH_US);
+  Serial.println(tmps);
+  for (int n=0; n<NUM_LANES; n++)
+  {
+    sprintf_P(tmps, PSTR("  GLITCHES L%d    %u"), n+1, capture_glitches(n));
+    Serial.println(tmps);
+  }
+  sprintf_P(tmps, PSTR("  PHOTO_FINISH   %d"), fPhoto);
+  Serial.println(tmps);
+  for (int n=0; n<NUM_LANES; n++)    // time in the beam vs the heat mean, heats with more than one break, heats with edges dropped
+  {
+    sprintf_P(tmps, PSTR("  ALIGN L%d       %u.%u%% %u %u"), n+1, photo_align(n) / 10, photo_align(n) % 10,
+              photo_chatter(n), photo_overflow(n));
+    Serial.println(tmps);
+  }
+#ifdef ENABLE_PROFILE
+  Serial.println(F("  ENABLE_PROFILE 1"));
+#else
+  Serial.println(F("  ENABLE_PROFILE 0"));
 #endif
 
 #ifdef LED_DISPLAY
-  Serial.println("  LED_DISPLAY    1");
-  sprintf(tmps,  "  MAX_DISP       %d", MAX_DISP);
+  Serial.println(F("  LED_DISPLAY    1"));
+  sprintf_P(tmps, PSTR("  MAX_DISP       %d"), MAX_DISP);
+  Serial.println(tmps);
+  sprintf_P(tmps, PSTR("  DISP BUS us    %lu"), disp_bus_us);
   Serial.println(tmps);
 #else
-  Serial.println("  LED_DISPLAY    0");
+  Serial.println(F("  LED_DISPLAY    0"));
 #endif
 
 #ifdef DUAL_DISP
-  Serial.println("  DUAL_DISP      1");
+  Serial.println(F("  DUAL_DISP      1"));
 #else
-  Serial.println("  DUAL_DISP      0");
+  Serial.println(F("  DUAL_DISP      0"));
 #endif
 #ifdef DUAL_MODE
-  Serial.println("  DUAL_MODE      1");
+  Serial.println(F("  DUAL_MODE      1"));
 #else
-  Serial.println("  DUAL_MODE      0");
+  Serial.println(F("  DUAL_MODE      0"));
 #endif
 
 #ifdef LARGE_DISP
-  Serial.println("  LARGE_DISP     1");
+  Serial.println(F("  LARGE_DISP     1"));
 #else
-  Serial.println("  LARGE_DISP     0");
+  Serial.println(F("  LARGE_DISP     0"));
 #endif
 
 #ifdef MATRIX_DISPLAY
-  Serial.println("  MATRIX_DISP    1");
-  sprintf(tmps,  "  NUM_MATRICES   %d", NUM_MATRICES);
+  Serial.println(F("  MATRIX_DISP    1"));
+  sprintf_P(tmps, PSTR("  NUM_MATRICES   %d"), NUM_MATRICES);
+  Serial.println(tmps);
+#ifdef MATRIX_HW_SPI
+  Serial.println(F("  MATRIX_HW_SPI  1"));
+#else
+  Serial.println(F("  MATRIX_HW_SPI  0"));
+#endif
+  sprintf_P(tmps, PSTR("  DISP SETUP us  %lu"), disp_setup_us);
+  Serial.println(tmps);
+  sprintf_P(tmps, PSTR("  DISP BUS us    %lu"), disp_bus_us);
   Serial.println(tmps);
 #else
-  Serial.println("  MATRIX_DISP    0");
+  Serial.println(F("  MATRIX_DISP    0"));
 #endif
+  sprintf_P(tmps, PSTR("  DISP CLEAR us  %lu"), disp_clear_us);
+  Serial.println(tmps);
+  sprintf_P(tmps, PSTR("  DISP UPDATE us %lu"), disp_update_us);
+  Serial.println(tmps);
 
-  Serial.println("");
+  Serial.println();
 
-  sprintf(tmps, "  ARDUINO VERS   %04d", ARDUINO);
+  sprintf_P(tmps, PSTR("  SERIAL BAUD    %lu"), serial_baud);
+  Serial.println(tmps);
+  sprintf_P(tmps, PSTR("  RESULT FORMAT  %s"), fBinary ? "binary" : "text");
+  Serial.println(tmps);
+#ifdef FAST_BOOT
+  Serial.println(F("  FAST_BOOT      1"));
+#else
+  Serial.println(F("  FAST_BOOT      0"));
+#endif
+  sprintf_P(tmps, PSTR("  RESET CAUSE    0x%02x"), reset_cause);
+  Serial.println(tmps);
+  sprintf_P(tmps, PSTR("  RESET RAM KEPT %d"), reset_ram);
+  Serial.println(tmps);
+  sprintf_P(tmps, PSTR("  BOOT READY us  %lu"), boot_ready_us);
+  Serial.println(tmps);
+  sprintf_P(tmps, PSTR("  RAM STATIC     %u"), ram_static());
+  Serial.println(tmps);
+  sprintf_P(tmps, PSTR("  RAM FREE MIN   %u"), ram_free());
+  Serial.println(tmps);
+#ifdef WATCHDOG
+  Serial.println(F("  WATCHDOG       1"));
+#else
+  Serial.println(F("  WATCHDOG       0"));
+#endif
+  sprintf_P(tmps, PSTR("  HEAT RESTORED  %s"), heat_restored == SAVE_RAM ? "ram" : heat_restored == SAVE_EEPROM ? "eeprom" : "none");
+  Serial.println(tmps);
+  if (hist_range(&first, &last))
+  {
+    sprintf_P(tmps, PSTR("  HISTORY        %u-%u"), first, last);
+  }
+  else
+  {
+    sprintf_P(tmps, PSTR("  HISTORY        none"));
+  }
+  Serial.println(tmps);
+  sprintf_P(tmps, PSTR("  TASKS DROPPED  %u"), task_dropped());
+  Serial.println(tmps);
+  sprintf_P(tmps, PSTR("  ARDUINO VERS   %04d"), ARDUINO);
   Serial.println(tmps);
-  sprintf(tmps, "  COMPILE DATE   %s", __DATE__);
+  sprintf_P(tmps, PSTR("  COMPILE DATE   %s"), __DATE__);
   Serial.println(tmps);
-  sprintf(tmps, "  COMPILE TIME   %s", __TIME__);
+  sprintf_P(tmps, PSTR("  COMPILE TIME   %s"), __TIME__);
   Serial.println(tmps);
 
-  Serial.println("-----------------------------");
+  Serial.println(F("-----------------------------"));
 
   return;
 }
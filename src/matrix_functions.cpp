@@ -1,7 +1,21 @@
-#include <LedControl_SW_SPI.h>
 #include "matrix_functions.h"
+#ifdef MATRIX_HW_SPI
+#include <SPI.h>
+#else
+#include <LedControl_SW_SPI.h>
 
 LedControl_SW_SPI lc=LedControl_SW_SPI();
+#endif
+
+//MAX7219 registers
+#define REG_DECODE     0x09
+#define REG_INTENSITY  0x0A
+#define REG_SCANLIMIT  0x0B
+#define REG_SHUTDOWN   0x0C
+#define REG_TEST       0x0F
+
+unsigned long disp_setup_us = 0;
+unsigned long disp_bus_us = 0;
 byte zero[8]= {B00000000,B00000000,B01111100,B10100010,B10010010,B10001010,B01111100,B00000000};
 byte one[8] = {B00000000,B00000000,B00000000,B11111110,B01000000,B00100000,B00000000,B00000000};
 byte two[8] = {B00000000,B00000000,B01100010,B10010010,B10010010,B10010010,B10001110,B00000000};
@@ -12,39 +26,143 @@ byte ltrp[8]= {B00000000,B00000000,B01100000,B10010000,B10010000,B10010000,B1111
 byte dash[8]= {B00000000,B00000000,B00001000,B00001000,B00001000,B00000000,B00000000,B00000000};
 byte plus[8]= {B00000000,B00000000,B00000000,B00010000,B00111000,B00010000,B00000000,B00000000};
 
+byte blank[8]= {B00000000,B00000000,B00000000,B00000000,B00000000,B00000000,B00000000,B00000000};
+
+/*================================================================================*
+  FRAMEBUFFER
+
+  showChar() only updates the in-RAM copy of each matrix and marks the rows
+  that changed. flush_displays() then sends each dirty row to every device in
+  the chain in one chip-select transaction, so a full frame costs 8
+  transactions of 16*NUM_MATRICES bits instead of 8*NUM_MATRICES transactions
+  that each shift the whole chain (128*N bits vs 128*N*N), and glyphs that are
+  already showing cost nothing. flush_display_row() sends just the next dirty
+  row, for callers that need to bound the time spent on the bus.
+ *================================================================================*/
+byte frame[NUM_MATRICES][8];           // row data per matrix
+byte frame_dirty = 0;                  // rows changed on any matrix (bit per row)
+
+/*================================================================================*
+  DISPLAY BUS
+
+  With MATRIX_HW_SPI the chain is clocked by the SPI peripheral at SPI_SPEED
+  (about 1 us per byte, so a full 4-matrix frame is well under 100 us);
+  otherwise every bit is shifted out in software on DATA_PIN/CLK_PIN.
+  The SPI port is started by the first register or row write, whichever
+  comes first: setup() sets the brightness before setup_displays() runs,
+  and SPI.transfer() would wait forever on a port that is not enabled.
+  disp_bus_us keeps the longest row write, the bus time the racing loop
+  spends per display slice, so both backends can be compared.
+ *================================================================================*/
+void matrix_byte(byte b) {
+#ifdef MATRIX_HW_SPI
+  SPI.transfer(b);
+#else
+  shiftOut(DATA_PIN, CLK_PIN, MSBFIRST, b);
+#endif
+}
+
+#ifdef MATRIX_HW_SPI
+boolean spi_ready = false;
+
+void matrix_spi_begin() {
+  if (spi_ready) return;
+
+  pinMode(CS_PIN, OUTPUT);
+  digitalWrite(CS_PIN, HIGH);
+  SPI.begin();
+  SPI.beginTransaction(SPISettings(SPI_SPEED, MSBFIRST, SPI_MODE0));   //matrices are the only SPI device
+  spi_ready = true;
+}
+
+void matrix_reg_all(byte reg, byte data) {
+  matrix_spi_begin();
+  digitalWrite(CS_PIN, LOW);
+  for (int d=0;d<NUM_MATRICES;d++) {
+    matrix_byte(reg);
+    matrix_byte(data);
+  }
+  digitalWrite(CS_PIN, HIGH);
+}
+#endif
+
+byte *glyph(char c_char) {
+  if(c_char == '0') return zero;
+  else if(c_char == '1') return one;
+  else if(c_char == '2') return two;
+  else if(c_char == '3') return three;
+  else if(c_char == '4') return four;
+  else if(c_char == 'O') return ltro;
+  else if(c_char == 'P') return ltrp;
+  else if(c_char == '-') return dash;
+  else if(c_char == '+') return plus;
+  else return blank;
+}
+
 void showChar(int addr, char c_char) {
-  if(c_char == '0')
-      for (int i=0;i<8;i++) lc.setRow(addr, i, zero[i]);
-  else if(c_char == '1')
-      for (int i=0;i<8;i++) lc.setRow(addr, i, one[i]);
-  else if(c_char == '2')
-      for (int i=0;i<8;i++) lc.setRow(addr, i, two[i]);
-  else if(c_char == '3')
-      for (int i=0;i<8;i++) lc.setRow(addr, i, three[i]);
-  else if(c_char == '4')
-      for (int i=0;i<8;i++) lc.setRow(addr, i, four[i]);
-  else if(c_char == 'O')
-      for (int i=0;i<8;i++) lc.setRow(addr, i, ltro[i]);
-  else if(c_char == 'P')
-      for (int i=0;i<8;i++) lc.setRow(addr, i, ltrp[i]);
-  else if(c_char == '-')
-      for (int i=0;i<8;i++) lc.setRow(addr, i, dash[i]);
-  else if(c_char == '+')
-      for (int i=0;i<8;i++) lc.setRow(addr, i, plus[i]);
-  else //blank
-      for (int i=0;i<8;i++) lc.setRow(addr, i, B00000000);
+  byte *g = glyph(c_char);
+
+  for (int i=0;i<8;i++) {
+    if (frame[addr][i] != g[i]) {
+      frame[addr][i] = g[i];
+      frame_dirty |= _BV(i);
+    }
+  }
+}
+
+boolean flush_display_row() {
+  int i = 0;
+  unsigned long t0;
 
+  if (!frame_dirty) return false;
+  while (!(frame_dirty & _BV(i))) i++;
+
+#ifdef MATRIX_HW_SPI
+  matrix_spi_begin();
+#endif
+  t0 = micros();
+  digitalWrite(CS_PIN, LOW);
+  for (int d=NUM_MATRICES-1;d>=0;d--) {   //last device in the chain goes first
+    matrix_byte(i+1);   //digit register for row i
+    matrix_byte(frame[d][i]);
+  }
+  digitalWrite(CS_PIN, HIGH);
+  disp_bus_us = max(disp_bus_us, micros() - t0);
+
+  frame_dirty &= ~_BV(i);
+  return true;
+}
+
+void flush_displays() {
+  while (flush_display_row());
 }
 
 void setup_displays() {
+  unsigned long t0 = micros();
+
   //7 segment displays are chained after the matrices
+#ifdef MATRIX_HW_SPI
+  matrix_spi_begin();
+
+  Serial.println(F("Init display"));
+  matrix_reg_all(REG_TEST, 0);
+  matrix_reg_all(REG_DECODE, 0);
+  matrix_reg_all(REG_SCANLIMIT, 7);
+  matrix_reg_all(REG_SHUTDOWN, 1); //wakeup
+
+  memset(frame, 0, sizeof(frame));
+  frame_dirty = 0xFF;              //clear all rows
+#else
   lc.begin(DATA_PIN,CLK_PIN,CS_PIN,NUM_MATRICES);
 
   for (int i=0;i<NUM_MATRICES;i++) {
-    Serial.println("Init display");
+    Serial.println(F("Init display"));
     lc.shutdown(i,false); //wakeup
     lc.clearDisplay(i);
   }
+  memset(frame, 0, sizeof(frame));
+  frame_dirty = 0;
+#endif
 
   //now show lane numbers
   for (int n=0;n<NUM_LANES;n++) {
@@ -56,8 +174,9 @@ void setup_displays() {
       showChar(NUM_LANES+n, (char)48+NUM_LANES-n);
     }
   }
+  flush_displays();
 
-  delay(5000);
+  disp_setup_us = micros() - t0;
 }
 
 void show_brightness_pattern(int display_level) {
@@ -67,7 +186,11 @@ void show_brightness_pattern(int display_level) {
 }
 
 void set_display_brightness(int display_level) {
+#ifdef MATRIX_HW_SPI
+  matrix_reg_all(REG_INTENSITY, display_level);
+#else
   for (int i=0;i<NUM_MATRICES;i++) {
     lc.setIntensity(i,display_level);
   }
+#endif
 }
\ No newline at end of file
@@ -1,16 +1,28 @@
 #ifndef MATRIX_VARS_H
 #define MATRIX_VARS_H
 
-//import global config
-#define NUM_LANES    4
+#include <Arduino.h>
+#include "timer_config.h"              // NUM_LANES
 
+//#define MATRIX_HW_SPI 1              //Drive matrices from the hardware SPI port instead of bit-banging
+
+#ifdef MATRIX_HW_SPI
+#define CS_PIN         7               //Chip Select Pin - data on MOSI (11), clock on SCK (13)
+#define SPI_SPEED      8000000         //SPI clock (MAX7219 max is 10 MHz)
+#else
 #define DATA_PIN       6               //Data Pin
 #define CLK_PIN        7               //Clock Pin
 #define CS_PIN         13              //Chip Select Pin - reusing this pin instead of solenoid
+#endif
 #define NUM_MATRICES   4               //Number of 8x8 matrices/modules in use
 
+extern unsigned long disp_setup_us;    //time taken to initialize and draw the matrices
+extern unsigned long disp_bus_us;      //longest row write on the display bus
+
 void setup_displays();
 void showChar(int addr, char c_char);
+void flush_displays();
+boolean flush_display_row();
 void show_brightness_pattern(int display_level);
 void set_display_brightness(int display_level);
 
@@ -0,0 +1,150 @@
+#ifndef ARDUINO_NATIVE_H
+#define ARDUINO_NATIVE_H
+
+/*================================================================================*
+  NATIVE ARDUINO SHIM
+
+  Just enough of the Arduino core for the timer to build on the host
+  (platformio env:native). Pins, port snapshots, serial and the display bus
+  are backed by the simulated hardware in hal_native.cpp, which runs on a
+  deterministic virtual clock instead of real time.
+ *================================================================================*/
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include "binary.h"
+
+#define ARDUINO      10819
+
+typedef uint8_t byte;
+typedef bool    boolean;
+
+#define HIGH         1
+#define LOW          0
+#define INPUT        0
+#define OUTPUT       1
+#define INPUT_PULLUP 2
+#define LSBFIRST     0
+#define MSBFIRST     1
+#define DEC          10
+#define HEX          16
+
+#define A0           14
+#define A1           15
+#define A2           16
+#define A3           17
+#define A4           18
+#define A5           19
+
+#define bitRead(value, bit) (((value) >> (bit)) & 0x01)
+#define bit(b)       (1UL << (b))
+#define _BV(b)       (1 << (b))
+#define min(a,b)     ((a)<(b)?(a):(b))
+#define max(a,b)     ((a)>(b)?(a):(b))
+
+void pinMode(uint8_t pin, uint8_t mode);
+int  digitalRead(uint8_t pin);
+void digitalWrite(uint8_t pin, uint8_t val);
+int  analogRead(uint8_t pin);
+void analogWrite(uint8_t pin, int val);
+void shiftOut(uint8_t dataPin, uint8_t clockPin, uint8_t bitOrder, uint8_t val);
+
+unsigned long millis();
+unsigned long micros();
+void delay(unsigned long ms);
+void delayMicroseconds(unsigned int us);
+
+/*-----------------------------------------*
+  - AVR registers used by the timer -
+ *-----------------------------------------*/
+extern volatile uint8_t PIND, PINB, PINC;              // port snapshots
+extern volatile uint8_t PCICR, PCIFR, PCMSK0, PCMSK1, PCMSK2;    // pin change interrupts
+
+extern volatile uint8_t MCUSR;                         // reset cause
+
+#define PORF         0
+#define EXTRF        1
+#define BORF         2
+#define WDRF         3
+
+#define PCIE0        0
+#define PCIE1        1
+#define PCIE2        2
+#define PCIF0        0
+#define PCIF1        1
+#define PCIF2        2
+
+#define ISR(vector)  extern "C" void vector(void)
+#define cli()        hal_cli()
+#define sei()        hal_sei()
+
+extern "C" void PCINT0_vect(void);
+extern "C" void PCINT1_vect(void);
+extern "C" void PCINT2_vect(void);
+
+void hal_cli();
+void hal_sei();
+
+/*-----------------------------------------*
+  - flash strings (avr/pgmspace.h), plain RAM on the host -
+ *-----------------------------------------*/
+class __FlashStringHelper;
+
+#define PROGMEM
+#define PSTR(s)          (s)
+#define F(s)             ((const __FlashStringHelper *)(s))
+#define pgm_read_byte(p) (*(const uint8_t *)(p))
+#define sprintf_P        sprintf
+#define snprintf_P       snprintf
+#define strcpy_P         strcpy
+#define strncat_P        strncat
+#define strlen_P         strlen
+
+/*-----------------------------------------*
+  - serial port -
+ *-----------------------------------------*/
+class Print
+{
+  public:
+    virtual size_t write(uint8_t c) = 0;
+    size_t write(const uint8_t *buf, size_t len);
+    size_t write(const char *str) { return write((const uint8_t *)str, strlen(str)); }
+
+    size_t print(const char *str);
+    size_t print(const __FlashStringHelper *str) { return print((const char *)str); }
+    size_t print(char c);
+    size_t print(int n, int base = DEC);
+    size_t print(unsigned int n, int base = DEC);
+    size_t print(long n, int base = DEC);
+    size_t print(unsigned long n, int base = DEC);
+    size_t print(double n, int digits = 2);
+
+    size_t println();
+    size_t println(const char *str);
+    size_t println(const __FlashStringHelper *str) { return println((const char *)str); }
+    size_t println(char c);
+    size_t println(int n, int base = DEC);
+    size_t println(unsigned int n, int base = DEC);
+    size_t println(long n, int base = DEC);
+    size_t println(unsigned long n, int base = DEC);
+    size_t println(double n, int digits = 2);
+};
+
+class HardwareSerial : public Print
+{
+  public:
+    void begin(unsigned long baud);
+    void end() {}
+    int available();
+    int read();
+    int availableForWrite();
+    void flush();
+    using Print::write;
+    size_t write(uint8_t c);
+};
+
+extern HardwareSerial Serial;
+
+#endif //ARDUINO_NATIVE_H
@@ -0,0 +1,36 @@
+#ifndef EEPROM_NATIVE_H
+#define EEPROM_NATIVE_H
+
+#include <Arduino.h>
+
+/*================================================================================*
+  NATIVE EEPROM SHIM
+
+  The Uno's 1 KB EEPROM, backed by hal_native.cpp. A byte write takes 3.4 ms
+  of virtual time, during which eeprom_is_ready() is false.
+ *================================================================================*/
+bool eeprom_is_ready();
+
+class EEPROMClass
+{
+  public:
+    uint8_t read(int idx);
+    void write(int idx, uint8_t val);
+    void update(int idx, uint8_t val);
+    uint16_t length();
+
+    template <typename T> T &get(int idx, T &t)
+    {
+      for (size_t i=0; i<sizeof(T); i++) ((uint8_t *)&t)[i] = read(idx + i);
+      return t;
+    }
+    template <typename T> const T &put(int idx, const T &t)
+    {
+      for (size_t i=0; i<sizeof(T); i++) update(idx + i, ((const uint8_t *)&t)[i]);
+      return t;
+    }
+};
+
+extern EEPROMClass EEPROM;
+
+#endif //EEPROM_NATIVE_H
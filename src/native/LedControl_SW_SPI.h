@@ -0,0 +1,55 @@
+#ifndef LEDCONTROL_SW_SPI_NATIVE_H
+#define LEDCONTROL_SW_SPI_NATIVE_H
+
+#include <Arduino.h>
+
+/*================================================================================*
+  NATIVE LEDCONTROL SHIM
+
+  Speaks the same MAX7219 protocol as the real library over the simulated
+  bus (shiftOut/digitalWrite), so display traffic costs the same virtual
+  time as it would on the Uno.
+ *================================================================================*/
+class LedControl_SW_SPI
+{
+  public:
+    void begin(int dataPin, int clkPin, int csPin, int numDevices=1)
+    {
+      data = dataPin; clk = clkPin; cs = csPin; devices = numDevices;
+      pinMode(data, OUTPUT);
+      pinMode(clk, OUTPUT);
+      pinMode(cs, OUTPUT);
+      digitalWrite(cs, HIGH);
+
+      for (int i=0; i<devices; i++)
+      {
+        transfer(i, 0x0F, 0);          // display test off
+        transfer(i, 0x0B, 7);          // scan limit
+        transfer(i, 0x09, 0);          // no decode
+        clearDisplay(i);
+        shutdown(i, true);
+      }
+    }
+
+    void shutdown(int addr, bool status) { transfer(addr, 0x0C, status ? 0 : 1); }
+    void setScanLimit(int addr, int limit) { transfer(addr, 0x0B, limit); }
+    void setIntensity(int addr, int intensity) { transfer(addr, 0x0A, intensity); }
+    void setRow(int addr, int row, byte value) { transfer(addr, row+1, value); }
+    void clearDisplay(int addr) { for (int i=0; i<8; i++) transfer(addr, i+1, 0); }
+
+  private:
+    int data, clk, cs, devices;
+
+    void transfer(int addr, byte opcode, byte value)
+    {
+      digitalWrite(cs, LOW);
+      for (int d=devices-1; d>=0; d--)
+      {
+        shiftOut(data, clk, MSBFIRST, d == addr ? opcode : 0);
+        shiftOut(data, clk, MSBFIRST, d == addr ? value : 0);
+      }
+      digitalWrite(cs, HIGH);
+    }
+};
+
+#endif //LEDCONTROL_SW_SPI_NATIVE_H
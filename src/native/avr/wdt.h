@@ -0,0 +1,27 @@
+#ifndef WDT_NATIVE_H
+#define WDT_NATIVE_H
+
+#include <stdint.h>
+
+/*================================================================================*
+  NATIVE WATCHDOG SHIM
+
+  hal_native.cpp times the gaps between wdt_reset() calls against the
+  timeout; a gap that would have reset the Uno is reported, not acted on.
+ *================================================================================*/
+#define WDTO_15MS    0
+#define WDTO_30MS    1
+#define WDTO_60MS    2
+#define WDTO_120MS   3
+#define WDTO_250MS   4
+#define WDTO_500MS   5
+#define WDTO_1S      6
+#define WDTO_2S      7
+#define WDTO_4S      8
+#define WDTO_8S      9
+
+void wdt_enable(uint8_t timeout);
+void wdt_disable();
+void wdt_reset();
+
+#endif //WDT_NATIVE_H
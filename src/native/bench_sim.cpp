@@ -0,0 +1,202 @@
+#include <algorithm>                    // before Arduino.h, which defines min/max
+#include <chrono>
+#include <random>
+#include <Arduino.h>
+#include "timer_config.h"
+#include "timebase_functions.h"
+#include "capture_functions.h"
+#include "race_engine.h"
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#define BENCH_TSC      1
+#endif
+
+/*================================================================================*
+  RACING LOOP MICROBENCHMARK
+
+  Times the racing loop's finish path on the host, the same code the Uno
+  runs. The capture ISR decodes a port snapshot (capture_edges), the loop
+  drains the event (capture_read) and RaceEngine places the lanes. The
+  engine is built for NUM_LANES as in main.cpp, with empty display hooks.
+  Heats get random finish orders with ties, and idle passes run between
+  finishes:
+    idle pass      nothing crossed: drain an empty ring, check the timeout
+    finish pass    snapshot decoded, event drained, lanes timed and placed
+    lane scan      idle pass as the loop did it before, one lane at a time
+  Every heat is checked: tied lanes must share a time and a place.
+  Host times only compare builds with each other. They are not Uno cycles.
+
+    usage: program -u <heats> [options]
+      -s <seed>        random seed (default 1)
+      -i <pct>         chance a car ties the car before it (default 20)
+      -g <passes>      idle passes between finishes (default 64)
+ *================================================================================*/
+#define BENCH_NULL     (9999UL * (TB_TICKS_PER_SEC / 1000))    // NULL_TICKS in main.cpp
+
+extern byte LANE_DET[];
+
+static unsigned long b_time [NUM_LANES];
+static int           b_place[NUM_LANES];
+static boolean       b_mask [NUM_LANES];
+
+class BenchRace : public RaceEngine<BenchRace, NUM_LANES, BENCH_NULL>
+{
+public:
+  BenchRace() : RaceEngine(b_time, b_place, b_mask), done(0) {}
+
+  void lane_done(byte lane, boolean timeout) { done += lane + timeout; }
+  unsigned long cutoff(unsigned long) { return BENCH_NULL; }
+  unsigned int held(unsigned long by) { return capture_held(by); }
+
+  unsigned long done;                  // keeps the hooks from being optimized away
+};
+
+static BenchRace race;
+
+
+/*-----------------------------------------*
+  - host clock (TSC cycles where there is one) -
+ *-----------------------------------------*/
+static inline unsigned long long bench_now()
+{
+#ifdef BENCH_TSC
+  return __rdtsc();
+#else
+  return std::chrono::duration_cast<std::chrono::nanoseconds>(
+           std::chrono::steady_clock::now().time_since_epoch()).count();
+#endif
+}
+
+
+/*-----------------------------------------*
+  - idle pass as the loop did it before -
+ *-----------------------------------------*/
+static __attribute__((noinline)) int lane_scan(unsigned long now, unsigned long start, unsigned long cutoff)
+{
+  int timed_out = 0;
+
+  for (int n=0; n<NUM_LANES; n++)
+  {
+    if (b_time[n] == 0 && !b_mask[n] && (now - start) > cutoff) timed_out++;
+  }
+
+  return timed_out;
+}
+
+
+int bench_sim(int argc, char *argv[])
+{
+  long heats = 0;
+  unsigned seed = 1;
+  double p_tie = 20;
+  int gap = 64;
+  unsigned long long idle_t = 0, finish_t = 0, scan_t = 0, t0;
+  unsigned long idle_n = 0, finish_n = 0, scan_n = 0, tie_errors = 0, ties = 0;
+  volatile int sink = 0;
+
+
+  for (int i=1; i+1<argc; i+=2)
+  {
+    if      (!strcmp(argv[i], "-u")) heats = atol(argv[i+1]);
+    else if (!strcmp(argv[i], "-s")) seed = atoi(argv[i+1]);
+    else if (!strcmp(argv[i], "-i")) p_tie = atof(argv[i+1]);
+    else if (!strcmp(argv[i], "-g")) gap = max(1, atoi(argv[i+1]));
+  }
+
+  std::mt19937 rng(seed);
+  std::uniform_real_distribution<double> pct(0.0, 100.0);
+
+  lane_map(LANE_DET, NUM_LANES);
+  auto wall_start = std::chrono::steady_clock::now();
+
+  for (long h=0; h<heats; h++)
+  {
+    int order[NUM_LANES];
+    byte snap[CAPTURE_PORTS] = {0, 0, 0};
+    unsigned long now = 1000;
+    unsigned int lanes;
+    unsigned long when;
+
+    for (int n=0; n<NUM_LANES; n++)
+    {
+      order[n] = n;
+      b_time[n] = 0;
+      b_place[n] = 0;
+      b_mask[n] = false;
+    }
+    std::shuffle(order, order + NUM_LANES, rng);
+
+    capture_begin();
+    race.start(0);
+
+/*-----------------------------------------*
+  - finishes, some tied, with idle passes between -
+ *-----------------------------------------*/
+    for (int k=0; k<NUM_LANES; k++)
+    {
+      snap[PIN_PORT(LANE_DET[order[k]])] |= _BV(PIN_BIT(LANE_DET[order[k]]));
+      if (k + 1 < NUM_LANES && pct(rng) < p_tie)
+      {
+        ties++;
+        continue;                      // next car in the same snapshot
+      }
+
+      t0 = bench_now();
+      for (int i=0; i<gap; i++)
+      {
+        while (capture_read(&lanes, &when)) race.finish(lanes, when);
+        race.check_timeout(now + i);
+      }
+      idle_t += bench_now() - t0;
+      idle_n += gap;
+
+      t0 = bench_now();
+      for (int i=0; i<gap; i++) sink += lane_scan(now + i, 0, BENCH_NULL);
+      scan_t += bench_now() - t0;
+      scan_n += gap;
+
+      now += 1000 + rng() % 1000;
+      t0 = bench_now();
+      capture_edges(snap, now);
+      while (capture_read(&lanes, &when)) race.finish(lanes, when);
+      race.check_timeout(now);
+      finish_t += bench_now() - t0;
+      finish_n++;
+    }
+    capture_end();
+
+/*-----------------------------------------*
+  - check: same time means same place -
+ *-----------------------------------------*/
+    for (int m=0; m<NUM_LANES; m++)
+    {
+      for (int n=0; n<NUM_LANES; n++)
+      {
+        if ((b_time[m] == b_time[n]) != (b_place[m] == b_place[n]) || !b_time[n]) tie_errors++;
+      }
+    }
+    if (race.running()) tie_errors++;
+  }
+
+  double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - wall_start).count();
+
+/*-----------------------------------------*
+  - report -
+ *-----------------------------------------*/
+#ifdef BENCH_TSC
+  const char *unit = "TSC cycles";
+#else
+  const char *unit = "ns";
+#endif
+  printf("heats            %ld (seed %u, %d lanes, %lu ties, %d idle passes between finishes)\n",
+         heats, seed, NUM_LANES, ties, gap);
+  printf("idle pass        %.1f %s (drain empty ring, timeout check)\n", idle_n ? idle_t / (double)idle_n : 0.0, unit);
+  printf("finish pass      %.1f %s (decode snapshot, drain, time and place)\n",
+         finish_n ? finish_t / (double)finish_n : 0.0, unit);
+  printf("lane scan        %.1f %s (previous per-lane idle check, for comparison)\n",
+         scan_n ? scan_t / (double)scan_n : 0.0, unit);
+  printf("tie errors       %lu (tied lanes with different places, or lanes left unplaced)\n", tie_errors);
+  printf("host time        %.3f s\n", wall);
+
+  return tie_errors ? 1 : 0;
+}
@@ -0,0 +1,213 @@
+#include <algorithm>                    // before Arduino.h, which defines min/max
+#include <random>
+#include <string>
+#include <vector>
+#include <Arduino.h>
+#include "hal_native.h"
+#include "timebase_functions.h"
+#include "matrix_functions.h"
+
+/*================================================================================*
+  COMMAND STREAM SIMULATOR
+
+  Streams host commands at the timer while it sits in the ready state and
+  checks that every one is answered, in order. Commands go out in bursts
+  written back to back - single characters, single characters with a digit
+  and framed commands mixed together, sometimes with the digit of a single
+  character command late or missing, sometimes with a broken frame - and
+  the host waits for the replies to one burst before sending the next.
+  Replies are longer than commands, so at equal baud a burst much over 64
+  bytes outruns the Uno's receive buffer while the timer is blocked on its
+  own output; -p 40 at 9600 shows where that starts.
+
+    usage: program -q <commands> [options]
+      -s <seed>        random seed (default 1)
+      -p <n>           longest burst (default 6)
+      -g <ms>          longest gap between bursts (default 20)
+      -b <code>        negotiate a serial baud first (SMSG_SBAUD code, default none)
+ *================================================================================*/
+#define MS(x)          ((unsigned long long)((x) * (TB_TICKS_PER_SEC / 1000.0) + 0.5))
+#define REPLY_WAIT     500             // ms to wait for a burst's replies
+
+void setup();
+void loop();
+
+struct sim_cmd {
+  std::string send;
+  std::string reply;                   // expected reply line
+  double      late_ms;                 // send the last byte this much later (0 = with the rest)
+};
+
+static std::vector<std::string> lines;
+static std::string rx_line;
+
+
+static void cmd_sink(uint8_t c)
+{
+  if (c == '\r') return;
+  if (c != '\n')
+  {
+    rx_line += (char)c;
+    return;
+  }
+  lines.push_back(rx_line);
+  rx_line.clear();
+}
+
+
+static void run_for(unsigned long long ticks)
+{
+  unsigned long long end = hal_now() + ticks;
+
+  while (hal_now() < end)
+  {
+    loop();
+    hal_advance(1);
+  }
+}
+
+
+/*-----------------------------------------*
+  - one random command and its reply -
+ *-----------------------------------------*/
+static sim_cmd random_cmd(std::mt19937 &rng)
+{
+  char tmps[32];
+  sim_cmd c;
+
+
+  c.late_ms = 0;
+  switch (rng() % 12)
+  {
+    case 0:  c.send = "V";   c.reply = "vert=3.20"; break;
+    case 1:  c.send = "N";   c.reply = "numl=4";    break;
+    case 2:  c.send = "U";   c.reply = ".";         break;
+    case 3:  c.send = "G";   c.reply = ".";         break;
+    case 4:
+      sprintf(tmps, "M%d", (int)(rng() % NUM_LANES) + 1);
+      c.send = tmps; c.reply = ".";
+      if (rng() % 4 == 0) c.late_ms = rng() % 200;      // digit arrives late
+      break;
+    case 5:  c.send = "M";   c.reply = ".";         break;    // digit never comes
+    case 6:
+      sprintf(tmps, "<M%d,%d>", (int)(rng() % NUM_LANES) + 1, (int)(rng() % NUM_LANES) + 1);
+      c.send = tmps; c.reply = ".";
+      break;
+    case 7:  c.send = "<N>"; c.reply = "numl=4";    break;
+    case 8:  c.send = "<M1x>"; c.reply = "?";       break;    // rejected frame
+    case 9:                                          // argument too big for a long
+      c.send = (rng() & 1) ? "<M1,2147483648>" : "<M" + std::string(10 + rng() % 3, '9') + ">";
+      c.reply = "?";
+      break;
+    case 10: c.send = "<Q1,65536>"; c.reply = "?";  break;    // heat IDs are 16 bits
+    case 11: c.send = "<M65537>"; c.reply = ".";    break;    // no such lane, not lane 1
+  }
+
+  return c;
+}
+
+
+int cmd_sim(int argc, char *argv[])
+{
+  long count = 0, sent = 0;
+  unsigned seed = 1;
+  int burst_max = 6;
+  double gap_ms = 20;
+  const char *baud = NULL;
+  unsigned long lost = 0, wrong = 0, bursts = 0;
+  unsigned long long worst = 0;
+
+
+  for (int i=1; i+1<argc; i+=2)
+  {
+    if      (!strcmp(argv[i], "-q")) count = atol(argv[i+1]);
+    else if (!strcmp(argv[i], "-s")) seed = atoi(argv[i+1]);
+    else if (!strcmp(argv[i], "-p")) burst_max = max(1, atoi(argv[i+1]));
+    else if (!strcmp(argv[i], "-g")) gap_ms = atof(argv[i+1]);
+    else if (!strcmp(argv[i], "-b")) baud = argv[i+1];
+  }
+
+  std::mt19937 rng(seed);
+
+  hal_set_serial_sink(cmd_sink);
+  hal_set_warp(1000 * TB_TICKS_PER_US);
+  hal_reset_inputs();
+  setup();
+  while (std::find(lines.begin(), lines.end(), "K") == lines.end())    // wait for ready
+  {
+    loop();
+    hal_advance(1);
+  }
+  run_for(MS(200));                    // and the rest of the start-up output
+
+  if (baud)
+  {
+    char cmd[4];
+    sprintf(cmd, "X%.1s", baud);
+    hal_schedule_serial(hal_now() + MS(10), cmd);
+    hal_schedule_serial(hal_now() + MS(300), "X");
+    run_for(MS(1000));                 // confirm waits CMD_ARG_WAIT for a digit
+  }
+
+  while (sent < count)
+  {
+    std::vector<sim_cmd> burst;
+    std::string text;
+    unsigned long long t0, t;
+    int n = 1 + rng() % burst_max;
+
+/*-----------------------------------------*
+  - send a burst -
+ *-----------------------------------------*/
+    for (int i=0; i<n && sent<count; i++, sent++) burst.push_back(random_cmd(rng));
+
+    t = t0 = hal_now() + MS(rng() % (int)(gap_ms + 1));
+    for (size_t i=0; i<burst.size(); i++)
+    {
+      if (burst[i].late_ms)            // flush what we have, then the late digit
+      {
+        text += burst[i].send.substr(0, burst[i].send.size() - 1);
+        hal_schedule_serial(t, text.c_str());
+        t += MS(burst[i].late_ms);
+        text = burst[i].send.substr(burst[i].send.size() - 1);
+      }
+      else
+      {
+        text += burst[i].send;
+      }
+      if (text.size() > 48)
+      {
+        hal_schedule_serial(t, text.c_str());
+        text.clear();
+      }
+    }
+    if (!text.empty()) hal_schedule_serial(t, text.c_str());
+
+/*-----------------------------------------*
+  - wait for the replies -
+ *-----------------------------------------*/
+    lines.clear();
+    while (lines.size() < burst.size() && hal_now() < t + MS(REPLY_WAIT))
+    {
+      loop();
+      hal_advance(1);
+    }
+    worst = max(worst, hal_now() - t0);
+    bursts++;
+
+    for (size_t i=0; i<burst.size(); i++)
+    {
+      if (i >= lines.size()) lost++;
+      else if (lines[i] != burst[i].reply) wrong++;
+    }
+  }
+
+/*-----------------------------------------*
+  - report -
+ *-----------------------------------------*/
+  printf("commands         %ld in %lu bursts (seed %u, up to %d per burst)\n", count, bursts, seed, burst_max);
+  printf("replies          %lu missing, %lu wrong, %lu rx bytes dropped\n", lost, wrong, hal_rx_dropped());
+  printf("burst turnaround %.1f ms worst (first byte sent to last reply)\n", worst / (double)(TB_TICKS_PER_SEC / 1000));
+
+  return (lost || wrong || hal_rx_dropped()) ? 1 : 0;
+}
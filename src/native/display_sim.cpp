@@ -0,0 +1,147 @@
+#include <random>                       // before Arduino.h, which defines min/max
+#include <Arduino.h>
+#include <LedControl_SW_SPI.h>
+#include "hal_native.h"
+#include "timebase_functions.h"
+#include "matrix_functions.h"
+
+/*================================================================================*
+  DISPLAY BUS BENCHMARK
+
+  Counts the bits shifted out to the matrix chain for the same display
+  updates sent two ways:
+    old         each showChar() sets the matrix's 8 rows with setRow(),
+                and every setRow() shifts the whole chain (16 bits a device)
+    new         showChar() writes the framebuffer, and flush_displays()
+                sends each changed row once, to every device in one go
+  Both go over the simulated bus, so the virtual time is what the Uno
+  would spend bit-banging them. The updates are:
+    full frame  every matrix gets a random glyph
+    redraw      every matrix is sent the glyph it already shows
+    heat        what the timer shows over a heat: dashes when ready,
+                blanks at the start, then each lane's place as it finishes
+  The new way must never send more bits than the old one.
+
+    usage: program -d <frames> [options]
+      -s <seed>        random seed (default 1)
+ *================================================================================*/
+#define GLYPHS         "01234OP-+ "    // everything showChar() draws
+
+byte *glyph(char c_char);
+
+static LedControl_SW_SPI lc_old;
+
+struct bus_count {
+  unsigned long frames, bits;
+  unsigned long long ticks;
+};
+
+
+/*-----------------------------------------*
+  - one display update, sent the old way and the new way -
+ *-----------------------------------------*/
+static bool send(const char *chars, const int *addr, int count, bus_count *old_way, bus_count *new_way)
+{
+  unsigned long bits = hal_bus_bits(), old_bits;
+  unsigned long long t = hal_now();
+
+
+  for (int k=0; k<count; k++)
+  {
+    byte *g = glyph(chars[k]);
+
+    for (int i=0; i<8; i++) lc_old.setRow(addr[k], i, g[i]);
+  }
+  old_bits = hal_bus_bits() - bits;
+  old_way->bits  += old_bits;
+  old_way->ticks += hal_now() - t;
+  old_way->frames++;
+
+  bits = hal_bus_bits();
+  t = hal_now();
+  for (int k=0; k<count; k++) showChar(addr[k], chars[k]);
+  flush_displays();
+  new_way->bits  += hal_bus_bits() - bits;
+  new_way->ticks += hal_now() - t;
+  new_way->frames++;
+
+  return hal_bus_bits() - bits <= old_bits;
+}
+
+
+static void report(const char *name, const bus_count &o, const bus_count &n)
+{
+  double fo = o.frames ? o.frames : 1, fn = n.frames ? n.frames : 1;
+
+  printf("%-16s old %6.0f bits %7.1f us, new %6.0f bits %7.1f us per update (%lu updates)\n", name,
+         o.bits / fo, o.ticks / fo / TB_TICKS_PER_US, n.bits / fn, n.ticks / fn / TB_TICKS_PER_US, o.frames);
+}
+
+
+int display_sim(int argc, char *argv[])
+{
+  long frames = 0;
+  unsigned seed = 1;
+  unsigned long worse = 0;
+  bus_count full_old = {}, full_new = {}, same_old = {}, same_new = {}, heat_old = {}, heat_new = {};
+  char chars[NUM_MATRICES];
+  int addr[NUM_MATRICES];
+
+
+  for (int i=1; i+1<argc; i+=2)
+  {
+    if      (!strcmp(argv[i], "-d")) frames = atol(argv[i+1]);
+    else if (!strcmp(argv[i], "-s")) seed = atoi(argv[i+1]);
+  }
+
+  std::mt19937 rng(seed);
+
+  lc_old.begin(DATA_PIN, CLK_PIN, CS_PIN, NUM_MATRICES);
+  for (int d=0; d<NUM_MATRICES; d++) addr[d] = d;
+
+/*-----------------------------------------*
+  - full frames and redraws -
+ *-----------------------------------------*/
+  for (long f=0; f<frames; f++)
+  {
+    for (int d=0; d<NUM_MATRICES; d++) chars[d] = GLYPHS[rng() % (sizeof(GLYPHS) - 1)];
+    if (!send(chars, addr, NUM_MATRICES, &full_old, &full_new)) worse++;
+    if (!send(chars, addr, NUM_MATRICES, &same_old, &same_new)) worse++;
+  }
+
+/*-----------------------------------------*
+  - heats: ready, start, places as the lanes finish -
+ *-----------------------------------------*/
+  for (long f=0; f<frames; f++)
+  {
+    int order[NUM_LANES];
+
+    memset(chars, '-', sizeof(chars));
+    if (!send(chars, addr, NUM_MATRICES, &heat_old, &heat_new)) worse++;
+    memset(chars, ' ', sizeof(chars));
+    if (!send(chars, addr, NUM_MATRICES, &heat_old, &heat_new)) worse++;
+
+    for (int n=0; n<NUM_LANES; n++) order[n] = n;
+    for (int n=NUM_LANES-1; n>0; n--) std::swap(order[n], order[rng() % (n + 1)]);
+    for (int k=0; k<NUM_LANES; k++)
+    {
+      int lane = order[k];
+      char place = (rng() % 10) ? '1' + k : '-';    // some cars do not finish
+
+      if (!send(&place, &lane, 1, &heat_old, &heat_new)) worse++;
+    }
+  }
+
+/*-----------------------------------------*
+  - report -
+ *-----------------------------------------*/
+  printf("display chain    %d matrices, %ld frames and %ld heats (seed %u)\n", NUM_MATRICES, frames, frames, seed);
+  report("full frame", full_old, full_new);
+  report("redraw", same_old, same_new);
+  report("heat", heat_old, heat_new);
+  printf("per heat         old %.0f bits, new %.0f bits\n",
+         frames ? heat_old.bits / (double)frames : 0.0, frames ? heat_new.bits / (double)frames : 0.0);
+  printf("new sent more    %lu updates\n", worse);
+
+  return worse ? 1 : 0;
+}
@@ -0,0 +1,345 @@
+#include <algorithm>                    // before Arduino.h, which defines min/max
+#include <random>
+#include <vector>
+#include <Arduino.h>
+#include "timer_config.h"
+#include "timebase_functions.h"
+#include "race_engine.h"
+
+/*================================================================================*
+  RACE ENGINE CHECK
+
+  Runs RaceEngine on its own, for 1, NUM_LANES, 8 and 16 lanes, against a
+  plain per-lane model of the same heat. Each heat has random masked
+  lanes, arrivals with ties, cars that never arrive, and a timeout that is
+  either NULL_TICKS or a multiple of the winner's time. The loop is polled
+  at random intervals: arrivals confirmed by then are passed to finish()
+  in time order, then check_timeout() runs. Cars that tie come in one
+  event, or in two with the same time. When the glitch filter is on, a
+  car is confirmed a fixed time after it crosses, and held() reports it
+  until then, so the timeout must wait for it. Some heats are ended early
+  with end(). finish() is also given lanes that are masked or already in,
+  alone and along with real finishes, and must ignore them.
+
+  For every lane the engine must give the model's time and place (cars
+  that tie share both, places count distinct times, lanes timed out get
+  NULL_TICKS and the next place, lanes cut off by end() stay 0), and call
+  lane_done() exactly once, with the right timeout flag. finish() must
+  return whether any lane was still running, and running(), leader() and
+  last_finish() must agree with the model. Heat starts near the top of
+  the tick counter check that it wraps.
+
+    usage: program -k <heats> [options]
+      -s <seed>        random seed (default 1)
+      -i <pct>         chance a car ties the car before it (default 20)
+      -m <pct>         chance a lane is masked (default 10)
+      -d <pct>         chance a car never arrives (default 10)
+      -h <pct>         chance a car crosses within the glitch filter time before the cutoff (default 20)
+      -x <pct>         chance a heat is ended early with end() (default 5)
+ *================================================================================*/
+#define ENGINE_NULL    (9999UL * (TB_TICKS_PER_SEC / 1000))    // NULL_TICKS in main.cpp
+#define ENGINE_HOLD    (1000UL * TB_TICKS_PER_US)              // GLITCH_US in main.cpp
+#define ENGINE_MAX_LANES 16
+#define LAST_CAR       (9500UL * (TB_TICKS_PER_SEC / 1000))    // latest arrival (before NULL_TICKS)
+#define POLL_MAX       40000           // longest loop pass (ticks, a slow display write)
+#define LAST_POLL      (ENGINE_NULL + ENGINE_HOLD + POLL_MAX)    // past any timeout
+
+struct engine_opts {
+  double p_tie, p_mask, p_dnf, p_late, p_end;
+};
+
+struct engine_stats {
+  unsigned long heats, lanes, ties, timeouts, held, ended, errors;
+};
+
+static unsigned long e_time [ENGINE_MAX_LANES];
+static int           e_place[ENGINE_MAX_LANES];
+static boolean       e_mask [ENGINE_MAX_LANES];
+static int           e_done [ENGINE_MAX_LANES];    // lane_done() calls
+static boolean       e_tout [ENGINE_MAX_LANES];    // timeout flag of the last call
+static unsigned long e_at   [ENGINE_MAX_LANES];    // arrival (ticks from the start, 0 = never)
+static unsigned long e_mult;                       // cutoff in tenths of the winner's time (0 = NULL_TICKS)
+static unsigned long e_hold;                       // glitch filter delay (ticks, 0 = off)
+static unsigned long e_start, e_now;               // heat start, current poll
+
+
+template <byte Lanes>
+class EngineRace : public RaceEngine<EngineRace<Lanes>, Lanes, ENGINE_NULL>
+{
+public:
+  EngineRace() : RaceEngine<EngineRace<Lanes>, Lanes, ENGINE_NULL>(e_time, e_place, e_mask) {}
+
+  void lane_done(byte lane, boolean timeout)
+  {
+    e_done[lane]++;
+    e_tout[lane] = timeout;
+  }
+
+  unsigned long cutoff(unsigned long leader)
+  {
+    return e_mult ? min(leader * e_mult / 10, ENGINE_NULL) : ENGINE_NULL;
+  }
+
+  unsigned int held(unsigned long by)  // crossed by then, still in the glitch filter
+  {
+    unsigned int lanes = 0;
+
+    for (int n=0; n<Lanes; n++)
+    {
+      if (e_at[n] && e_at[n] <= by - e_start && e_at[n] + e_hold > e_now - e_start) lanes |= 1U << n;
+    }
+
+    return lanes;
+  }
+};
+
+
+/*-----------------------------------------*
+  - one lane count: random heats against the model -
+ *-----------------------------------------*/
+template <byte Lanes>
+static void run_heats(long heats, std::mt19937 &rng, const engine_opts &o, engine_stats *st)
+{
+  std::uniform_real_distribution<double> pct(0.0, 100.0);
+  EngineRace<Lanes> race;
+  static const unsigned long mults[] = {0, 12, 15, 20, 30};
+
+
+  for (long h=0; h<heats; h++)
+  {
+    unsigned long order[Lanes] = {};
+    int cars = 0;
+
+    e_mult  = mults[rng() % 5];
+    e_hold  = (rng() & 1) ? ENGINE_HOLD : 0;
+    e_start = (rng() % 8) ? rng() : 0xFFFFFFFFUL - rng() % ENGINE_NULL;    // sometimes wraps in the heat
+    e_now   = e_start;
+
+    for (int n=0; n<Lanes; n++)
+    {
+      e_time[n]  = 0;                  // main.cpp clears these before a heat
+      e_place[n] = 0;
+      e_done[n]  = 0;
+      e_tout[n]  = false;
+      e_mask[n]  = pct(rng) < o.p_mask;
+      e_at[n]    = 0;
+      if (e_mask[n] || pct(rng) < o.p_dnf) continue;
+
+      if (cars && pct(rng) < o.p_tie)
+      {
+        e_at[n] = order[rng() % cars];
+        st->ties++;
+      }
+      else
+      {
+        e_at[n] = (TB_TICKS_PER_SEC / 1000) + rng() % LAST_CAR;
+      }
+      order[cars++] = e_at[n];
+      st->lanes++;
+    }
+    st->heats++;
+
+    unsigned long lead = 0, cut = ENGINE_NULL;
+    for (int n=0; n<Lanes; n++)
+    {
+      if (e_at[n] && (!lead || e_at[n] < lead)) lead = e_at[n];
+    }
+    if (lead) cut = e_mult ? min(lead * e_mult / 10, ENGINE_NULL) : ENGINE_NULL;
+
+    if (cars > 1 && pct(rng) < o.p_late)    // a car still in the filter at the cutoff
+    {
+      for (int n=0; n<Lanes; n++)
+      {
+        if (!e_at[n] || e_at[n] == lead) continue;
+
+        e_at[n] = max(lead + 1, cut - rng() % ENGINE_HOLD);
+        break;
+      }
+    }
+
+/*-----------------------------------------*
+  - the model: timeout poll, then times and places -
+ *-----------------------------------------*/
+    std::vector<unsigned long> polls;
+    unsigned long end_at = (pct(rng) < o.p_end) ? 1 + rng() % LAST_POLL : 0;
+
+    for (unsigned long p = 1 + rng() % POLL_MAX; p < LAST_POLL; p += 1 + rng() % POLL_MAX) polls.push_back(p);
+    polls.push_back(LAST_POLL);
+
+    unsigned long t_out = 0, t_end = 0, prev = 0;
+
+    auto left = [&](unsigned long p)   // lanes not in by poll p
+    {
+      boolean any = false;
+      for (int n=0; n<Lanes; n++) any |= !e_mask[n] && (!e_at[n] || e_at[n] + e_hold > p);
+      return any;
+    };
+    auto waiting = [&](unsigned long p)    // crossed by the cutoff, still in the glitch filter
+    {
+      boolean any = false;
+      for (int n=0; n<Lanes; n++) any |= e_at[n] && e_at[n] <= cut && e_at[n] + e_hold > p;
+      return any;
+    };
+
+    for (unsigned long p : polls)
+    {
+      if (!left(prev)) break;          // the loop stops once every lane is in
+      if (end_at && p >= end_at) { t_end = p; break; }
+      if (p > cut && left(p) && !waiting(p)) { t_out = p; break; }
+      prev = p;
+    }
+
+    unsigned long want_time[Lanes], want_lead = 0, last = 0;
+    unsigned long stop = t_out ? t_out : t_end ? prev : LAST_POLL;
+    int want_place[Lanes];
+    boolean want_tout[Lanes];
+
+    for (int n=0; n<Lanes; n++)
+    {
+      want_tout[n] = false;
+      if (e_mask[n])                                  want_time[n] = 0;
+      else if (e_at[n] && e_at[n] + e_hold <= stop)   want_time[n] = e_at[n];
+      else if (t_out)                               { want_time[n] = ENGINE_NULL; want_tout[n] = true; }
+      else                                            want_time[n] = 0;
+
+      last = max(last, want_time[n]);
+      if (want_time[n] && !want_tout[n] && (!want_lead || want_time[n] < want_lead)) want_lead = want_time[n];
+    }
+    for (int n=0; n<Lanes; n++)
+    {
+      want_place[n] = 0;
+      if (!want_time[n]) continue;
+
+      want_place[n] = 1;
+      for (int m=0; m<Lanes; m++)      // distinct earlier times
+      {
+        boolean first = true;
+
+        if (!want_time[m] || want_time[m] >= want_time[n]) continue;
+        for (int k=0; k<m; k++)
+        {
+          if (want_time[k] == want_time[m]) first = false;
+        }
+        if (first) want_place[n]++;
+      }
+    }
+    if (t_out) st->timeouts++;
+    if (t_end) st->ended++;
+
+/*-----------------------------------------*
+  - the engine: poll, finish in time order, timeout -
+ *-----------------------------------------*/
+    unsigned long fed = 0;             // arrivals up to this time are in
+    boolean was_held = false;
+
+    race.start(e_start);
+
+    for (unsigned long p : polls)
+    {
+      if (!race.running()) break;
+
+      e_now = e_start + p;
+      if (t_end && p >= t_end)
+      {
+        race.end();
+        break;
+      }
+
+      for (;;)                         // confirmed arrivals, oldest first
+      {
+        unsigned long next = 0;
+        unsigned int lanes = 0, noise = 0, first;
+
+        for (int n=0; n<Lanes; n++)
+        {
+          if (e_at[n] > fed && e_at[n] + e_hold <= p && (!next || e_at[n] < next)) next = e_at[n];
+        }
+        if (!next) break;
+
+        for (int n=0; n<Lanes; n++)
+        {
+          if (e_at[n] == next) lanes |= 1U << n;
+          if (e_mask[n] || (e_at[n] && e_at[n] <= fed)) noise |= (rng() & 1) << n;
+        }
+        fed = next;
+        first = (rng() & 1) ? lanes & -lanes : lanes;    // a tie in one event, or split over two
+
+        if ((noise && race.finish(noise, e_start + next)) || !race.finish(first | noise, e_start + next) ||
+            (lanes != first && !race.finish(lanes & ~first, e_start + next)))
+        {
+          st->errors++;
+          fprintf(stderr, "engine: %d lanes, heat %ld: finish() at %lu returned the wrong result\n", Lanes, h, next);
+        }
+      }
+
+      if (e_hold && race.running() && p > cut && race.held(e_start + cut)) was_held = true;
+      race.check_timeout(e_start + p);
+    }
+    if (was_held) st->held++;
+
+/*-----------------------------------------*
+  - check -
+ *-----------------------------------------*/
+    boolean bad = race.running() != 0;
+
+    for (int n=0; n<Lanes; n++)
+    {
+      if (e_time[n] != want_time[n] || e_place[n] != want_place[n]) bad = true;
+      if (e_done[n] != (want_time[n] ? 1 : 0) || e_tout[n] != want_tout[n]) bad = true;
+    }
+    if (race.leader() != want_lead || race.last_finish() != last) bad = true;
+
+    if (bad)
+    {
+      st->errors++;
+      fprintf(stderr, "engine: %d lanes, heat %ld (cutoff x%lu/10, hold %lu, timeout %lu, end %lu):\n",
+              Lanes, h, e_mult, e_hold, t_out, t_end);
+      for (int n=0; n<Lanes; n++)
+      {
+        fprintf(stderr, "  lane %d: at %lu%s -> time %lu place %d done %d%s, want %lu place %d%s\n", n + 1,
+                e_at[n], e_mask[n] ? " masked" : "", e_time[n], e_place[n], e_done[n], e_tout[n] ? " timeout" : "",
+                want_time[n], want_place[n], want_tout[n] ? " timeout" : "");
+      }
+    }
+  }
+
+  return;
+}
+
+
+int engine_sim(int argc, char *argv[])
+{
+  long heats = 0;
+  unsigned seed = 1;
+  engine_opts o = {20, 10, 10, 20, 5};
+  engine_stats st = {};
+
+
+  for (int i=1; i+1<argc; i+=2)
+  {
+    if      (!strcmp(argv[i], "-k")) heats = atol(argv[i+1]);
+    else if (!strcmp(argv[i], "-s")) seed = atoi(argv[i+1]);
+    else if (!strcmp(argv[i], "-i")) o.p_tie = atof(argv[i+1]);
+    else if (!strcmp(argv[i], "-m")) o.p_mask = atof(argv[i+1]);
+    else if (!strcmp(argv[i], "-d")) o.p_dnf = atof(argv[i+1]);
+    else if (!strcmp(argv[i], "-h")) o.p_late = atof(argv[i+1]);
+    else if (!strcmp(argv[i], "-x")) o.p_end = atof(argv[i+1]);
+  }
+
+  std::mt19937 rng(seed);
+
+  run_heats<1>(heats, rng, o, &st);
+  run_heats<NUM_LANES>(heats, rng, o, &st);
+  run_heats<8>(heats, rng, o, &st);
+  run_heats<16>(heats, rng, o, &st);
+
+/*-----------------------------------------*
+  - report -
+ *-----------------------------------------*/
+  printf("heats            %lu (seed %u, %ld each for 1, %d, 8 and 16 lanes)\n", st.heats, seed, heats, NUM_LANES);
+  printf("cars             %lu (%lu ties)\n", st.lanes, st.ties);
+  printf("heat ends        %lu timeouts (%lu waited for a held lane), %lu ended early\n", st.timeouts, st.held, st.ended);
+  printf("engine errors    %lu (time, place, lane_done, finish(), running, leader or last finish)\n", st.errors);
+
+  return st.errors ? 1 : 0;
+}
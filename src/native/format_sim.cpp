@@ -0,0 +1,170 @@
+#include <Arduino.h>
+#include "timebase_functions.h"
+
+/*================================================================================*
+  TIME FORMAT CHECK
+
+  Runs tb_format() over every tick from 0 to NULL_TIME and checks it
+  against what Print::printFloat() made of the same time as a float, the
+  way results were printed before times were kept in ticks. The AVR's
+  double is a 32-bit float, so printFloat() is emulated in float here.
+  The text must be the same for every time.
+
+  It also counts where both differ from the exact decimal value of the
+  tick count rounded half up. printFloat() only has 24 bits for a value
+  of up to 10 s, so where a time sits exactly on a half digit (for 4
+  decimals, a tick count ending in 100) the float is a little above or
+  below it and rounds either way. Above 4 s a float step is more than a
+  tick, so a time a tick past half way can land on it too. Every
+  difference must be one of these, by one unit in the last digit.
+
+    usage: program -p <digits> [options]
+      -m <msecs>       last time checked (default 9999, NULL_TIME)
+ *================================================================================*/
+#define FORMAT_MAX_MS  9999            // NULL_TIME in main.cpp
+
+/*-----------------------------------------*
+  - Print::printFloat() on the AVR (double = float) -
+ *-----------------------------------------*/
+static void avr_print_float(char *buf, float number, int digits)
+{
+  float rounding = 0.5f, remainder;
+  unsigned long int_part;
+  char *p;
+
+
+  for (int i=0; i<digits; i++) rounding /= 10.0f;
+  number += rounding;
+
+  int_part = (unsigned long)number;
+  remainder = number - (float)int_part;
+  p = buf + sprintf(buf, "%lu", int_part);
+
+  if (digits > 0) *p++ = '.';
+  while (digits-- > 0)
+  {
+    unsigned int digit;
+
+    remainder *= 10.0f;
+    digit = (unsigned int)remainder;
+    *p++ = '0' + digit;
+    remainder -= digit;
+  }
+  *p = '\0';
+
+  return;
+}
+
+
+/*-----------------------------------------*
+  - exact decimal value, rounded half up -
+ *-----------------------------------------*/
+static void exact_format(char *buf, size_t size, unsigned long ticks, int digits)
+{
+  unsigned long long scale = 1, q, r;
+
+
+  for (int d=0; d<digits; d++) scale *= 10;
+
+  q = (unsigned long long)ticks * scale / TB_TICKS_PER_SEC;
+  r = (unsigned long long)ticks * scale % TB_TICKS_PER_SEC;
+  if (2 * r >= TB_TICKS_PER_SEC) q++;
+
+  if (digits > 0) snprintf(buf, size, "%llu.%0*u", q / scale, digits, (unsigned int)(q % scale));
+  else            snprintf(buf, size, "%llu", q);
+
+  return;
+}
+
+
+/*-----------------------------------------*
+  - last digits of a formatted time, as an integer -
+ *-----------------------------------------*/
+static long long as_units(const char *s)
+{
+  long long v = 0;
+
+
+  for (; *s; s++)
+  {
+    if (*s >= '0' && *s <= '9') v = v * 10 + (*s - '0');
+  }
+
+  return v;
+}
+
+
+int format_sim(int argc, char *argv[])
+{
+  int digits = 4;
+  unsigned long max_ms = FORMAT_MAX_MS, last;
+  unsigned long checked = 0, wrong = 0, ex_diff = 0, ex_tie = 0, ex_near = 0, ex_far = 0;
+  unsigned long first_wrong = 0, first_far = 0;
+  char tb[24], ex[24], pf[24];
+
+
+  for (int i=1; i+1<argc; i+=2)
+  {
+    if      (!strcmp(argv[i], "-p")) digits = atoi(argv[i+1]);
+    else if (!strcmp(argv[i], "-m")) max_ms = atol(argv[i+1]);
+  }
+  if (digits < 0 || digits > 6)
+  {
+    fprintf(stderr, "format: digits must be 0 to 6\n");
+    return 1;
+  }
+
+  last = max_ms * (TB_TICKS_PER_SEC / 1000);
+
+  for (unsigned long t=0; t<=last; t++)
+  {
+    unsigned long long scale = 1;
+    long long off;
+    float secs, ulp;
+
+    tb_format(tb, t, digits);
+    exact_format(ex, sizeof(ex), t, digits);
+    avr_print_float(pf, (float)t / TB_TICKS_PER_SEC, digits);
+    checked++;
+
+    if (strcmp(tb, pf))
+    {
+      if (!wrong) first_wrong = t;
+      wrong++;
+    }
+    if (!strcmp(tb, ex)) continue;
+
+    ex_diff++;
+    for (int d=0; d<digits; d++) scale *= 10;
+    off = (long long)((unsigned long long)t * scale * 2 % (2 * TB_TICKS_PER_SEC)) - TB_TICKS_PER_SEC;
+
+    secs = (float)t / TB_TICKS_PER_SEC;
+    ulp  = nextafterf(secs, 1e9f) - secs;
+
+    if (llabs(as_units(ex) - as_units(tb)) > 1 || (double)llabs(off) / (2.0 * TB_TICKS_PER_SEC) / scale > ulp)
+    {
+      if (!ex_far) first_far = t;
+      ex_far++;
+    }
+    else if (off == 0)
+    {
+      ex_tie++;                        // exactly half way: the float may be just under it
+    }
+    else
+    {
+      ex_near++;                       // within a float step of half way
+    }
+  }
+
+  printf("times            %lu (0 to %lu ms in %d ticks/us, %d decimals)\n",
+         checked, max_ms, TB_TICKS_PER_US, digits);
+  printf("tb_format        %lu differ from printFloat", wrong);
+  if (wrong) printf(" (first at %lu ticks)", first_wrong);
+  printf("\n");
+  printf("exact rounding   %lu differ: %lu exactly half way, %lu within a float step of it, %lu elsewhere",
+         ex_diff, ex_tie, ex_near, ex_far);
+  if (ex_far) printf(" (first at %lu ticks)", first_far);
+  printf("\n");
+
+  return (wrong || ex_far) ? 1 : 0;
+}
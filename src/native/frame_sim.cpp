@@ -0,0 +1,221 @@
+#include <random>                       // before Arduino.h, which defines min/max
+#include <vector>
+#include <Arduino.h>
+#include "pdt_frame.h"                 // before frame_functions.h, whose macros share its names
+#include "frame_functions.h"
+
+/*================================================================================*
+  RESULT FRAME ROUND TRIP FUZZ
+
+  Encodes random heats with the timer's frame_encode() and decodes them
+  with host/pdt_frame.h, one byte at a time as they would come off the
+  port, with text lines in between. Most frames go out intact; the rest
+  are damaged on the way:
+    corrupt     a byte changed (sometimes to the sync byte)
+    truncate    the frame cut short, the next one follows at once
+    splice      the start of one frame joined to the end of another
+  Truncation and splicing always take at least both CRC bytes. A frame
+  that only lost its last byte is accepted whenever the next frame's sync
+  byte happens to match it (1 in 256), and takes that sync byte with it;
+  the data is still right, and nothing short of a length byte fixes it.
+    header      a bad version or lane count right after a sync byte
+  Every intact frame must come out exactly as it went in, with its
+  sequence number, and the decoder must never hold a whole frame's worth
+  of bytes. A damaged frame can pass the CRC by chance (about 1 in 65536);
+  those are counted, and only fail the run if there are far too many.
+
+    usage: program -z <frames> [options]
+      -s <seed>        random seed (default 1)
+      -d <pct>         chance a frame is damaged (default 30)
+ *================================================================================*/
+struct sent_frame {
+  unsigned int  seq;
+  int           lanes;
+  unsigned long ticks[FRAME_MAX_LANES];
+  int           place[FRAME_MAX_LANES];
+  byte          mask_bits, dnf_bits;
+  bool          intact;
+};
+
+
+/*-----------------------------------------*
+  - decoded frame is exactly the one sent -
+ *-----------------------------------------*/
+static bool same(const sent_frame &f, const pdt::heat_result &r)
+{
+  if (r.seq != (uint16_t)f.seq || r.lanes != f.lanes || r.mask_bits != f.mask_bits || r.dnf_bits != f.dnf_bits)
+  {
+    return false;
+  }
+  for (int n=0; n<f.lanes; n++)
+  {
+    if (r.ticks[n] != f.ticks[n] || r.place[n] != f.place[n]) return false;
+  }
+
+  return true;
+}
+
+
+int frame_sim(int argc, char *argv[])
+{
+  long frames = 0;
+  unsigned seed = 1;
+  double p_damage = 30;
+  unsigned long damaged = 0, intact = 0, decoded = 0, missed = 0, wrong = 0, bad = 0, text = 0;
+  unsigned long max_held = 0, overruns = 0;
+  std::vector<sent_frame> sent;
+  std::vector<byte> stream;
+  std::vector<long> frame_at;          // stream offset of each sent frame's last byte
+
+
+  for (int i=1; i+1<argc; i+=2)
+  {
+    if      (!strcmp(argv[i], "-z")) frames = atol(argv[i+1]);
+    else if (!strcmp(argv[i], "-s")) seed = atoi(argv[i+1]);
+    else if (!strcmp(argv[i], "-d")) p_damage = atof(argv[i+1]);
+  }
+
+  std::mt19937 rng(seed);
+  std::uniform_real_distribution<double> pct(0.0, 100.0);
+
+/*-----------------------------------------*
+  - build the stream -
+ *-----------------------------------------*/
+  byte prev[FRAME_SIZE(FRAME_MAX_LANES)];
+  int  prev_len = 0;
+
+  for (long i=0; i<frames; i++)
+  {
+    sent_frame f;
+    byte buf[FRAME_SIZE(FRAME_MAX_LANES)];
+    int len;
+
+    f.seq = (i + 1) & 0xFFFF;
+    f.lanes = 1 + rng() % FRAME_MAX_LANES;
+    f.mask_bits = rng() & ((1 << f.lanes) - 1);
+    f.dnf_bits = rng() & ((1 << f.lanes) - 1) & ~f.mask_bits;
+    for (int n=0; n<f.lanes; n++)
+    {
+      f.ticks[n] = rng() % 20000000UL;
+      f.place[n] = rng() % (f.lanes + 1);
+    }
+    len = frame_encode(buf, f.seq, f.lanes, f.ticks, f.place, f.mask_bits, f.dnf_bits);
+    f.intact = pct(rng) >= p_damage;
+
+    if (rng() % 4 == 0)                // a text line between frames
+    {
+      const char *line = (rng() & 1) ? "K\r\n" : "B\r\n";
+      stream.insert(stream.end(), line, line + 3);
+    }
+
+    if (f.intact)
+    {
+      stream.insert(stream.end(), buf, buf + len);
+      intact++;
+    }
+    else
+    {
+      std::vector<byte> d(buf, buf + len);
+
+      switch (rng() % 4)
+      {
+        case 0:                        // corrupt
+          {
+            int k = 1 + rng() % (len - 1);
+            d[k] = (rng() & 1) && d[k] != FRAME_SYNC ? FRAME_SYNC : d[k] ^ (1 + rng() % 255);
+          }
+          break;
+        case 1:                        // truncate
+          d.resize(1 + rng() % (len - 2));
+          break;
+        case 2:                        // splice onto the end of the previous frame
+          if (prev_len)                // past the sequence number, short of the CRC
+          {
+            int cut = 5 + rng() % (len - 7);
+            d.assign(buf, buf + cut);
+            d.insert(d.end(), prev + min(cut, prev_len - 2), prev + prev_len);
+          }
+          else
+          {
+            d.resize(len / 2);
+          }
+          break;
+        default:                       // bad header
+          if (rng() & 1) d[1] = FRAME_VERSION + 1 + rng() % 200;
+          else           d[2] = (rng() & 1) ? 0 : FRAME_MAX_LANES + 1 + rng() % 200;
+          break;
+      }
+      stream.insert(stream.end(), d.begin(), d.end());
+      damaged++;
+    }
+    memcpy(prev, buf, len);
+    prev_len = len;
+
+    sent.push_back(f);
+    frame_at.push_back(stream.size() - 1);
+  }
+
+/*-----------------------------------------*
+  - decode it a byte at a time -
+ *-----------------------------------------*/
+  pdt::frame_decoder dec;
+  pdt::heat_result r;
+  std::vector<bool> got(sent.size(), false);
+  unsigned long collisions = 0;
+  size_t next = 0;                     // first sent frame not yet passed in the stream
+
+  for (size_t i=0; i<stream.size(); i++)
+  {
+    switch (dec.feed(stream[i], &r))
+    {
+      case pdt::FRAME_OK:
+      {
+        bool found = false;
+
+        decoded++;
+        for (size_t k=(next > 8 ? next - 8 : 0); k<sent.size() && k<next+2 && !found; k++)
+        {
+          if (!got[k] && same(sent[k], r))
+          {
+            got[k] = found = true;
+            if (!sent[k].intact) collisions++;    // damaged frame that still checks out
+          }
+        }
+        if (!found) { wrong++; collisions++; }
+        break;
+      }
+      case pdt::FRAME_BAD:
+        bad++;
+        break;
+      case pdt::FRAME_NONE:
+        text++;
+        break;
+      default:
+        break;
+    }
+
+    max_held = max(max_held, (unsigned long)dec.held());
+    if (dec.held() >= (size_t)pdt::FRAME_MAX_SIZE) overruns++;
+    while (next < sent.size() && frame_at[next] <= (long)i) next++;
+  }
+
+  for (size_t k=0; k<sent.size(); k++)
+  {
+    if (sent[k].intact && !got[k]) missed++;
+  }
+
+/*-----------------------------------------*
+  - report -
+ *-----------------------------------------*/
+  double expect = damaged / 65536.0;
+
+  printf("frames           %ld (seed %u, %lu intact, %lu damaged, %zu stream bytes)\n",
+         frames, seed, intact, damaged, stream.size());
+  printf("decoded          %lu frames, %lu rejected, %lu text bytes passed through\n", decoded, bad, text);
+  printf("intact frames    %lu missed\n", missed);
+  printf("damaged accepted %lu (%.2f expected from the CRC), %lu not matching any frame sent\n",
+         collisions, expect, wrong);
+  printf("decoder buffer   %lu bytes held at most (%d max), %lu overruns\n", max_held, pdt::FRAME_MAX_SIZE, overruns);
+
+  return (missed || overruns || collisions > 4 * expect + 2) ? 1 : 0;
+}
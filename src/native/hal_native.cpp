@@ -0,0 +1,647 @@
+#include <deque>                       // before Arduino.h, which defines min/max
+#include <map>
+#include <vector>
+#include <Arduino.h>
+#include <EEPROM.h>
+#include <avr/wdt.h>
+#include "hal_native.h"
+#include "timebase_functions.h"
+
+/*================================================================================*
+  NATIVE HARDWARE SIMULATION
+
+  Everything runs on a virtual clock counted in timebase ticks (0.5 us).
+  The clock only moves when the firmware does something that costs time on
+  the Uno: pin and analog access, bit-banged display bytes, serial traffic
+  and delays. Scripted edges are applied at their exact tick as the clock
+  passes them and fire the real pin change ISRs, so a run is fully
+  deterministic and repeatable.
+ *================================================================================*/
+#define US(x)            ((unsigned long)(x) * TB_TICKS_PER_US)
+
+#define COST_DIGITAL_RD  US(4)         // virtual time charged per call
+#define COST_DIGITAL_WR  US(4)
+#define COST_ANALOG_RD   US(112)
+#define COST_ANALOG_WR   US(8)
+#define COST_SHIFT_BYTE  US(100)
+#define COST_SERIAL      US(2)
+#define COST_MICROS      US(1)
+#define COST_EEPROM_WR   US(3400)      // busy time per EEPROM byte (the CPU carries on)
+
+#define SERIAL_TX_BUF    64            // HardwareSerial transmit buffer
+#define SERIAL_RX_BUF    64            // HardwareSerial receive buffer
+#define EEPROM_SIZE      1024
+
+#define GATE_OPEN        LOW           // START_TRIP
+#define SWITCH_PRESSED   LOW
+
+extern byte LANE_DET[];
+extern byte START_GATE;
+extern byte RESET_SWITCH;
+
+volatile uint8_t PIND = 0, PINB = 0, PINC = 0;
+volatile uint8_t PCICR = 0, PCIFR = 0, PCMSK0 = 0, PCMSK1 = 0, PCMSK2 = 0;
+volatile uint8_t MCUSR = _BV(PORF);
+
+HardwareSerial Serial;
+
+struct sim_event {
+  int  pin;                            // -1 for serial, -2 for end, -3 next serial byte, -4 stall
+  int  level;
+  char text[64];
+};
+
+static std::multimap<unsigned long long, sim_event> events;    // equal times keep insert order
+static unsigned long long end_time = 0;
+
+static unsigned long long vclock = 0;  // virtual time (ticks)
+static bool irq_off = false;
+static uint8_t irq_pending = 0;        // PCIFR bits raised while interrupts are off
+
+static int analog_in[20];
+static uint8_t pin_mode[20];
+
+static std::deque<uint8_t> rx;
+static std::deque<uint8_t> rx_wire;    // host bytes not yet clocked in
+static unsigned long long tx_done = 0; // tick the UART finishes its queue
+static unsigned long byte_ticks = 0;
+static bool timestamps = false, line_start = true;
+static unsigned long serial_bytes = 0;
+static unsigned long rx_dropped = 0;   // bytes lost to a full receive buffer
+static void (*serial_sink)(uint8_t c) = NULL;
+
+static unsigned long long last_poll = 0;    // loop period, measured between serial polls
+static unsigned long poll_count = 0, poll_max = 0;
+static unsigned long poll_run = 0;     // polls the firmware actually made (not skipped by the warp)
+static unsigned long long poll_total = 0;
+
+static unsigned long warp_max = 0;     // longest idle stretch skipped in one go (0 = off)
+static bool idle = false;              // nothing but input reads since the last poll
+
+static unsigned long bus_bits = 0;    // bits shifted out to the displays
+
+enum { WORK_NONE, WORK_DISPLAY, WORK_SERIAL };
+static int work = WORK_NONE;           // blocking write the firmware is in
+static unsigned long long work_edge = 0;    // first interrupt edge during it (0 = none)
+static unsigned long work_edges[3];    // interrupt edges during each kind of write
+static unsigned long work_wait[3];     // longest from such an edge to the end of the write (ticks)
+
+static std::vector<uint8_t> eeprom(EEPROM_SIZE, 0xFF);
+static std::vector<unsigned long> eeprom_cell(EEPROM_SIZE, 0);    // writes per byte
+static unsigned long long eeprom_busy = 0;    // tick the current byte write ends
+static unsigned long eeprom_writes = 0;
+
+static unsigned long long wdt_timeout = 0;    // ticks (0 = disabled)
+static unsigned long long wdt_last = 0;      // last wdt_reset()
+static unsigned long long wdt_gap = 0;       // longest time between resets
+static unsigned long wdt_bites = 0;          // gaps that would have reset the Uno
+
+
+/*================================================================================*
+  INTERRUPTS
+ *================================================================================*/
+static void run_pending()
+{
+  irq_off = true;                      // ISRs run with interrupts disabled
+  if (irq_pending & _BV(PCIF0)) { irq_pending &= ~_BV(PCIF0); PCINT0_vect(); }    // vector order
+  if (irq_pending & _BV(PCIF1)) { irq_pending &= ~_BV(PCIF1); PCINT1_vect(); }
+  if (irq_pending & _BV(PCIF2)) { irq_pending &= ~_BV(PCIF2); PCINT2_vect(); }
+  irq_off = false;
+}
+
+void hal_cli() { irq_off = true; }
+
+void hal_sei()
+{
+  irq_off = false;
+  if (irq_pending) run_pending();
+}
+
+/*-----------------------------------------*
+  - edges that land in the middle of a display or serial write -
+ *-----------------------------------------*/
+static void work_begin(int what)
+{
+  work = what;
+  work_edge = 0;
+}
+
+static void work_end()
+{
+  if (work_edge) work_wait[work] = max(work_wait[work], (unsigned long)(vclock - work_edge));
+  work = WORK_NONE;
+}
+
+static void set_pin(int pin, int level)
+{
+  volatile uint8_t *port, *pcmsk;
+  uint8_t b, old, group;
+
+
+  if (pin < 0 || pin > 19) return;
+
+  group = pin < 8 ? 2 : pin < 14 ? 0 : 1;    // pin change group = PCIEn/PCIFn bit
+  port  = group == 2 ? &PIND : group == 0 ? &PINB : &PINC;
+  pcmsk = group == 2 ? &PCMSK2 : group == 0 ? &PCMSK0 : &PCMSK1;
+  b = _BV(pin < 8 ? pin : pin < 14 ? pin - 8 : pin - 14);
+  old = *port;
+
+  if (level) *port |= b; else *port &= ~b;
+  if (old == *port) return;
+
+  if ((PCICR & _BV(group)) && (*pcmsk & b))
+  {
+    irq_pending |= _BV(group);
+    if (work)
+    {
+      work_edges[work]++;
+      if (!work_edge) work_edge = vclock;
+    }
+  }
+
+  if (irq_pending && !irq_off) run_pending();
+}
+
+
+/*================================================================================*
+  VIRTUAL CLOCK
+ *================================================================================*/
+/*-----------------------------------------*
+  - host bytes arrive one byte time apart -
+ *-----------------------------------------*/
+static void serial_rx_byte()
+{
+  sim_event e;
+
+  do
+  {
+    if (rx.size() < SERIAL_RX_BUF - 1) rx.push_back(rx_wire.front());
+    else rx_dropped++;
+    rx_wire.pop_front();
+  } while (!rx_wire.empty() && !byte_ticks);    // port not open yet: all at once
+
+  if (!rx_wire.empty())
+  {
+    e.pin = -3;
+    e.level = 0;
+    e.text[0] = '\0';
+    events.insert(std::make_pair(vclock + byte_ticks, e));
+  }
+}
+
+static void serial_rx(sim_event &e)
+{
+  bool busy = !rx_wire.empty();        // a byte event is already pending
+
+  for (char *c = e.text; *c; c++) rx_wire.push_back(*c);
+  if (!busy && !rx_wire.empty()) serial_rx_byte();
+}
+
+unsigned long long hal_now() { return vclock; }
+unsigned long long hal_tx_done() { return max(tx_done, vclock); }
+unsigned long hal_rx_dropped() { return rx_dropped; }
+
+unsigned long hal_bus_bits() { return bus_bits; }
+
+void hal_advance(unsigned long ticks)
+{
+  unsigned long long target = vclock + ticks;
+
+
+  while (!events.empty() && events.begin()->first <= target)
+  {
+    sim_event e = events.begin()->second;
+
+    vclock = max(vclock, events.begin()->first);
+    events.erase(events.begin());
+    idle = false;
+
+    if (e.pin == -2) hal_finish();
+    else if (e.pin == -4) target = max(target, vclock + e.level);    // whatever is running takes that long
+    else if (e.pin == -1) serial_rx(e);
+    else if (e.pin == -3) serial_rx_byte();
+    else
+    {
+      if (e.pin >= 14) analog_in[e.pin] = e.level;
+      if (e.pin < 14 || e.level <= HIGH) set_pin(e.pin, e.level);    // A0-A5 as digital inputs too
+    }
+  }
+
+  vclock = target;
+  if (end_time && vclock >= end_time) hal_finish();
+}
+
+void hal_finish()
+{
+  fflush(stdout);
+  fprintf(stderr, "sim: end at %.4f s, %lu serial bytes, %lu display bus bits, %lu rx bytes dropped\n",
+          vclock / (double)TB_TICKS_PER_SEC, serial_bytes, bus_bits, rx_dropped);
+  fprintf(stderr, "sim: %lu eeprom bytes written, watchdog gap %.1f ms max, %lu timeouts\n",
+          eeprom_writes, wdt_gap / (double)(TB_TICKS_PER_SEC / 1000), wdt_bites);
+  exit(0);
+}
+
+void tb_begin() {}
+
+unsigned long tb_ticks() { return (unsigned long)vclock; }
+
+unsigned long micros() { hal_advance(COST_MICROS); return (unsigned long)(vclock / TB_TICKS_PER_US); }
+
+unsigned long millis() { return (unsigned long)(vclock / (TB_TICKS_PER_SEC / 1000)); }
+
+void delay(unsigned long ms) { hal_advance(ms * (TB_TICKS_PER_SEC / 1000)); }
+
+void delayMicroseconds(unsigned int us) { hal_advance(US(us)); }
+
+
+/*================================================================================*
+  EEPROM AND WATCHDOG
+ *================================================================================*/
+EEPROMClass EEPROM;
+
+bool eeprom_is_ready() { return vclock >= eeprom_busy; }
+
+uint8_t EEPROMClass::read(int idx) { return eeprom[idx % EEPROM_SIZE]; }
+
+uint16_t EEPROMClass::length() { return EEPROM_SIZE; }
+
+void EEPROMClass::write(int idx, uint8_t val)
+{
+  if (!eeprom_is_ready()) hal_advance(eeprom_busy - vclock);    // eeprom_write_byte() waits
+
+  idx %= EEPROM_SIZE;
+  eeprom[idx] = val;
+  eeprom_cell[idx]++;
+  eeprom_writes++;
+  eeprom_busy = vclock + COST_EEPROM_WR;
+  idle = false;
+}
+
+void EEPROMClass::update(int idx, uint8_t val)
+{
+  if (read(idx) != val) write(idx, val);
+}
+
+void wdt_enable(uint8_t timeout)
+{
+  wdt_timeout = (unsigned long long)(TB_TICKS_PER_SEC / 64) << timeout;    // 16 ms << WDTO_*
+  wdt_last = vclock;
+}
+
+void wdt_disable() { wdt_timeout = 0; }
+
+void wdt_reset()
+{
+  if (!wdt_timeout) return;
+
+  wdt_gap = max(wdt_gap, vclock - wdt_last);
+  if (vclock - wdt_last > wdt_timeout) wdt_bites++;
+  wdt_last = vclock;
+}
+
+
+/*================================================================================*
+  PINS
+ *================================================================================*/
+void pinMode(uint8_t pin, uint8_t mode) { if (pin < 20) pin_mode[pin] = mode; }
+
+int digitalRead(uint8_t pin)
+{
+  hal_advance(COST_DIGITAL_RD);
+  if (pin < 8) return bitRead(PIND, pin);
+  if (pin < 14) return bitRead(PINB, pin - 8);
+  if (pin < 20) return bitRead(PINC, pin - 14);
+  return LOW;
+}
+
+void digitalWrite(uint8_t pin, uint8_t val)
+{
+  hal_advance(COST_DIGITAL_WR);
+  idle = false;
+  if (pin >= 20 || pin_mode[pin] != OUTPUT) return;    // input pull-up only
+
+  set_pin(pin, val);
+}
+
+int analogRead(uint8_t pin)
+{
+  hal_advance(COST_ANALOG_RD);
+  return pin < 20 ? analog_in[pin] : 0;
+}
+
+void analogWrite(uint8_t pin, int val) { hal_advance(COST_ANALOG_WR); idle = false; }
+
+
+/*================================================================================*
+  DISPLAY BUS
+ *================================================================================*/
+void shiftOut(uint8_t dataPin, uint8_t clockPin, uint8_t bitOrder, uint8_t val)
+{
+  work_begin(WORK_DISPLAY);
+  hal_advance(COST_SHIFT_BYTE);
+  work_end();
+  bus_bits += 8;
+  idle = false;
+}
+
+
+/*================================================================================*
+  SERIAL PORT
+ *================================================================================*/
+void HardwareSerial::begin(unsigned long baud) { byte_ticks = 10 * TB_TICKS_PER_SEC / baud; }
+
+int HardwareSerial::available()
+{
+  unsigned long gap = vclock - last_poll;
+  unsigned long long room;
+  unsigned long skip;
+
+
+  poll_run++;
+  if (poll_count++)
+  {
+    poll_max = max(poll_max, gap);
+    poll_total += gap;
+  }
+
+  // an idle pass repeats identically until the next event, so skip whole passes
+  if (warp_max && idle && gap && rx.empty() && poll_count > 1)
+  {
+    room = events.empty() ? warp_max : min(events.begin()->first - vclock, (unsigned long long)warp_max);
+    skip = room ? (room - 1) / gap : 0;
+
+    vclock     += (unsigned long long)skip * gap;
+    poll_count += skip;
+    poll_total += (unsigned long long)skip * gap;
+  }
+  idle = true;
+  last_poll = vclock;
+
+  hal_advance(COST_SERIAL);
+  return rx.size();
+}
+
+int HardwareSerial::read()
+{
+  int c;
+
+  hal_advance(COST_SERIAL);
+  idle = false;
+  if (rx.empty()) return -1;
+  c = rx.front();
+  rx.pop_front();
+  return c;
+}
+
+int HardwareSerial::availableForWrite()
+{
+  unsigned long long queued;
+
+  if (!byte_ticks) return SERIAL_TX_BUF - 1;
+  queued = tx_done > vclock ? (tx_done - vclock + byte_ticks - 1) / byte_ticks : 0;
+  return queued >= SERIAL_TX_BUF - 1 ? 0 : SERIAL_TX_BUF - 1 - queued;
+}
+
+void HardwareSerial::flush() { if (tx_done > vclock) hal_advance(tx_done - vclock); }
+
+size_t HardwareSerial::write(uint8_t c)
+{
+  work_begin(WORK_SERIAL);
+  hal_advance(COST_SERIAL);
+  idle = false;
+  if (availableForWrite() == 0)        // buffer full: wait for room
+  {
+    hal_advance(tx_done - vclock - (SERIAL_TX_BUF - 2) * byte_ticks);
+  }
+  work_end();
+  tx_done = max(tx_done, vclock) + byte_ticks;
+  serial_bytes++;
+
+  if (serial_sink)
+  {
+    serial_sink(c);
+    return 1;
+  }
+
+  if (timestamps && line_start) printf("[%10.4f] ", vclock / (double)TB_TICKS_PER_SEC);
+  line_start = (c == '\n');
+  putchar(c);
+
+  return 1;
+}
+
+size_t Print::write(const uint8_t *buf, size_t len)
+{
+  for (size_t i=0; i<len; i++) write(buf[i]);
+  return len;
+}
+
+size_t Print::print(const char *str) { return write(str); }
+size_t Print::print(char c) { return write((uint8_t)c); }
+size_t Print::print(int n, int base) { return print((long)n, base); }
+size_t Print::print(unsigned int n, int base) { return print((unsigned long)n, base); }
+
+size_t Print::print(long n, int base)
+{
+  char buf[24];
+  if (base != DEC) return print((unsigned long)n, base);
+  sprintf(buf, "%ld", n);
+  return write(buf);
+}
+
+size_t Print::print(unsigned long n, int base)
+{
+  char buf[24];
+  sprintf(buf, base == HEX ? "%lX" : "%lu", n);
+  return write(buf);
+}
+
+size_t Print::print(double number, int digits)    // same algorithm as the AVR core
+{
+  size_t n = 0;
+  double rounding = 0.5, remainder;
+  unsigned long int_part;
+
+
+  if (number < 0.0)
+  {
+    n += print('-');
+    number = -number;
+  }
+
+  for (int i=0; i<digits; i++) rounding /= 10.0;
+  number += rounding;
+
+  int_part = (unsigned long)number;
+  remainder = number - (double)int_part;
+  n += print(int_part);
+
+  if (digits > 0) n += print('.');
+  while (digits-- > 0)
+  {
+    remainder *= 10.0;
+    n += print((unsigned int)remainder);
+    remainder -= (unsigned int)remainder;
+  }
+
+  return n;
+}
+
+size_t Print::println() { return write("\r\n"); }
+size_t Print::println(const char *str) { return print(str) + println(); }
+size_t Print::println(char c) { return print(c) + println(); }
+size_t Print::println(int n, int base) { return print(n, base) + println(); }
+size_t Print::println(unsigned int n, int base) { return print(n, base) + println(); }
+size_t Print::println(long n, int base) { return print(n, base) + println(); }
+size_t Print::println(unsigned long n, int base) { return print(n, base) + println(); }
+size_t Print::println(double n, int digits) { return print(n, digits) + println(); }
+
+
+/*================================================================================*
+  SIMULATION CONTROL
+ *================================================================================*/
+void hal_set_timestamps(bool on) { timestamps = on; }
+
+void hal_set_serial_sink(void (*sink)(uint8_t c)) { serial_sink = sink; }
+
+/*
+  Idle warp: a loop pass that only read inputs, with nothing scheduled before
+  the next pass, will run identically again, so whole passes are skipped (up
+  to max_ticks at a time, never past the next event). Edges still land on
+  their exact tick; only time-driven firmware decisions such as the lane
+  timeout may be observed up to max_ticks late.
+*/
+void hal_set_warp(unsigned long max_ticks) { warp_max = max_ticks; }
+
+void hal_reset_inputs()
+{
+  PIND = 0;                            // lane beams clear
+  PINC = 0;
+  PINB = _BV(START_GATE - 8) | _BV(RESET_SWITCH - 8);    // gate closed, switch released
+  for (int n=0; n<20; n++) analog_in[n] = 512;
+}
+
+void hal_schedule(unsigned long long time, int pin, int level)
+{
+  sim_event e;
+
+  e.pin = pin;
+  e.level = level;
+  e.text[0] = '\0';
+  events.insert(std::make_pair(time, e));
+}
+
+void hal_schedule_serial(unsigned long long time, const char *text)
+{
+  sim_event e;
+
+  e.pin = -1;
+  e.level = 0;
+  strncpy(e.text, text, sizeof(e.text) - 1);
+  e.text[sizeof(e.text) - 1] = '\0';
+  events.insert(std::make_pair(time, e));
+}
+
+void hal_schedule_stall(unsigned long long time, unsigned long ticks)
+{
+  sim_event e;
+
+  e.pin = -4;
+  e.level = ticks;
+  e.text[0] = '\0';
+  events.insert(std::make_pair(time, e));
+}
+
+void hal_loop_stats(unsigned long *count, unsigned long *max_gap, unsigned long long *total)
+{
+  *count   = poll_count ? poll_count - 1 : 0;    // gaps, not polls
+  *max_gap = poll_max;
+  *total   = poll_total;
+}
+
+unsigned long hal_loop_runs() { return poll_run; }
+
+void hal_clear_loop_stats()
+{
+  poll_count = poll_max = poll_run = 0;
+  poll_total = 0;
+}
+
+void hal_eeprom_stats(unsigned long *writes, unsigned long *max_cell)
+{
+  *writes   = eeprom_writes;
+  *max_cell = 0;
+  for (int i=0; i<EEPROM_SIZE; i++) *max_cell = max(*max_cell, eeprom_cell[i]);
+}
+
+void hal_wdt_stats(unsigned long *max_gap, unsigned long *timeouts)
+{
+  *max_gap  = (unsigned long)wdt_gap;
+  *timeouts = wdt_bites;
+}
+
+void hal_work_stats(unsigned long *disp_edges, unsigned long *disp_wait, unsigned long *ser_edges, unsigned long *ser_wait)
+{
+  *disp_edges = work_edges[WORK_DISPLAY];
+  *disp_wait  = work_wait[WORK_DISPLAY];
+  *ser_edges  = work_edges[WORK_SERIAL];
+  *ser_wait   = work_wait[WORK_SERIAL];
+}
+
+
+/*================================================================================*
+  SCRIPT LOADING
+ *================================================================================*/
+
+static int level_arg(const char *s)
+{
+  if (!strcmp(s, "high") || !strcmp(s, "release") || !strcmp(s, "closed")) return HIGH;
+  return LOW;
+}
+
+void hal_load_script(FILE *f)
+{
+  char line[128], cmd[16], a1[64], a2[64];
+  double ms;
+  int n;
+  unsigned long long t;
+
+
+  hal_reset_inputs();
+
+  while (fgets(line, sizeof(line), f))
+  {
+    sim_event e;
+
+    a1[0] = a2[0] = '\0';
+    n = sscanf(line, "%lf %15s %63s %63s", &ms, cmd, a1, a2);
+    if (n < 2 || line[0] == '#') continue;
+
+    t = (unsigned long long)(ms * (TB_TICKS_PER_SEC / 1000) + 0.5);
+    e.level = 0;
+    e.text[0] = '\0';
+
+    if (!strcmp(cmd, "lane"))        { e.pin = LANE_DET[atoi(a1) - 1]; e.level = level_arg(a2); }
+    else if (!strcmp(cmd, "gate"))   { e.pin = START_GATE; e.level = !strcmp(a1, "open") ? GATE_OPEN : !GATE_OPEN; }
+    else if (!strcmp(cmd, "reset"))  { e.pin = RESET_SWITCH; e.level = !strcmp(a1, "press") ? SWITCH_PRESSED : !SWITCH_PRESSED; }
+    else if (!strcmp(cmd, "pin"))    { e.pin = atoi(a1); e.level = level_arg(a2); }
+    else if (!strcmp(cmd, "analog")) { e.pin = atoi(a1); e.level = atoi(a2); }
+    else if (!strcmp(cmd, "serial")) { e.pin = -1; strncpy(e.text, a1, sizeof(e.text) - 1); e.text[sizeof(e.text) - 1] = '\0'; }
+    else if (!strcmp(cmd, "stall"))  { e.pin = -4; e.level = atof(a1) * (TB_TICKS_PER_SEC / 1000); }
+    else if (!strcmp(cmd, "end"))    { e.pin = -2; }
+    else
+    {
+      fprintf(stderr, "sim: unknown command '%s'\n", cmd);
+      continue;
+    }
+
+    events.insert(std::make_pair(t, e));
+  }
+
+  if (events.empty() || events.rbegin()->second.pin != -2)    // no explicit end: run 1 s past last event
+  {
+    end_time = (events.empty() ? 0 : events.rbegin()->first) + TB_TICKS_PER_SEC;
+  }
+
+  return;
+}
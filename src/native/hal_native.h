@@ -0,0 +1,47 @@
+#ifndef HAL_NATIVE_H
+#define HAL_NATIVE_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+/*================================================================================*
+  NATIVE HARDWARE SIMULATION
+
+  Script lines are "<time ms> <command> [args]", applied in time order:
+    lane   <n> high|low        lane detector (high = beam broken)
+    gate   open|closed         start gate
+    reset  press|release       reset switch
+    pin    <p> high|low        any digital input (0-19, A0-A5 are 14-19)
+    analog <p> <0-1023>        analog input (e.g. brightness pot on 14/A0)
+    serial <text>              bytes received from the host
+    stall  <ms>                firmware stuck that long in whatever it is doing
+                               (a slow display or serial write); interrupts still run
+    end                        stop the simulation
+  Blank lines and lines starting with '#' are ignored.
+ *================================================================================*/
+void hal_load_script(FILE *f);
+void hal_set_timestamps(bool on);
+void hal_set_serial_sink(void (*sink)(uint8_t c));
+void hal_set_warp(unsigned long max_ticks);
+
+void hal_reset_inputs();
+void hal_schedule(unsigned long long time, int pin, int level);
+void hal_schedule_serial(unsigned long long time, const char *text);
+void hal_schedule_stall(unsigned long long time, unsigned long ticks);
+
+unsigned long long hal_now();
+unsigned long long hal_tx_done();     // tick the UART finishes sending what is queued
+unsigned long hal_rx_dropped();        // host bytes lost to a full receive buffer
+unsigned long hal_bus_bits();          // bits shifted out to the displays so far
+void hal_advance(unsigned long ticks);
+void hal_finish();
+
+void hal_loop_stats(unsigned long *count, unsigned long *max_gap, unsigned long long *total);
+unsigned long hal_loop_runs();         // loop passes actually run (the warp skips the rest)
+void hal_clear_loop_stats();
+void hal_eeprom_stats(unsigned long *writes, unsigned long *max_cell);
+void hal_wdt_stats(unsigned long *max_gap, unsigned long *timeouts);
+void hal_work_stats(unsigned long *disp_edges, unsigned long *disp_wait,    // pin change edges during a display
+                    unsigned long *ser_edges, unsigned long *ser_wait);     // or serial write, longest from one to its end
+
+#endif //HAL_NATIVE_H
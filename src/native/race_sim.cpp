@@ -0,0 +1,820 @@
+#include <chrono>                       // before Arduino.h, which defines min/max
+#include <map>
+#include <random>
+#include <Arduino.h>
+#include "hal_native.h"
+#include "timebase_functions.h"
+#include "matrix_functions.h"
+#include "pdt_frame.h"
+#include "capture_functions.h"
+#include "task_functions.h"
+
+/*================================================================================*
+  RACE SIMULATOR
+
+  Runs the firmware through synthetic heats on the simulated track and
+  checks every result against ground truth. Each heat unmasks all lanes,
+  masks a random set, resets the timer, opens the gate and drops cars on
+  the lanes at generated arrival times, optionally with ties, DNFs and a
+  serial command arriving mid-race. A heat can also end with the timer
+  restarting before the host has the results, which the host then asks
+  for again (SMSG_RSEND): a warm reset keeps RAM, a power cycle only has
+  the EEPROM copy. Every few heats the host can ask for the last few from
+  the timer's history (<Q first,last>) and check them against what it got
+  at the time. In continuous mode the host never sends SMSG_RESET: it waits
+  for the timer to rearm itself once the gate is closed and the lanes are
+  clear. With an adaptive heat timeout (SMSG_TMOUT) a car the timer gives
+  up on before it arrives (after the cutoff, as the timer works it out)
+  is scored as a DNF; one that crossed by the cutoff must be timed, and the heat length (gate
+  open to results sent) shows what the early end saves. Lanes can also see
+  glitches, short pulses on the sensor before the car arrives, which the
+  timer's glitch filter must reject without moving any finish time, and
+  the loop can stall (a long display or serial write) as a car crosses,
+  so the beam clears before the loop gets to the finish. The timer's
+  debug output can be on for the whole run; every finish that lands in
+  the middle of a display or serial write is counted, with how long the
+  write still had to go, and must still get its exact time.
+  In photo finish mode (SMSG_PHOTO) each car blocks the beam for its
+  length over a generated speed, and after the heat the host asks for the
+  photo finish data and checks the speed, midpoint and beam breaks of
+  every car against the truth; one lane's sensor can be made to see the
+  cars longer, which the timer's lane alignment must single out. A lane
+  that glitched may flicker again as its car clears the beam, which is
+  more edges than the timer keeps: the photo data must still count them,
+  and the timer must count the heat as overflowed on that lane.
+
+    usage: program -n <heats> [options]
+      -s <seed>        random seed (default 1)
+      -a normal|uniform arrival distribution (default normal)
+      -m <ms>          mean arrival time (default 3000)
+      -w <ms>          standard deviation / half width (default 150)
+      -d <pct>         chance a car does not finish (default 2)
+      -k <pct>         chance a lane is masked (default 5)
+      -i <pct>         chance a car ties an earlier car (default 5)
+      -c <pct>         chance of a serial command mid-race (default 10)
+      -x <us>          idle warp limit, 0 = simulate every pass (default 1000)
+      -b <code>        negotiate a serial baud first (SMSG_SBAUD code, default none)
+      -f 0|1           results as binary frames, decoded with host/pdt_frame.h (default 0)
+      -r <pct>         chance of a warm reset (watchdog) before the results are read (default 0)
+      -p <pct>         chance of a power cycle before the results are read (default 0)
+      -y <n>           every n heats, dump the last n from history and check them (default 0 = never,
+                       the EEPROM holds 30 heats of 4 lanes)
+      -o 0|1           continuous heats, the timer rearms itself (SMSG_AUTO, default 0)
+      -t 0|1|2         heat timeout mode (SMSG_TMOUT: NULL_TIME, winner multiple, session spread, default 0)
+      -h <pct>         -t 1|2: chance a car crosses in the last 2 ms before the cutoff (default 0)
+      -g <pct>         chance of a glitch on a lane before its car arrives (default 0)
+      -l <pct>         chance the loop stalls while a car crosses (default 0)
+      -e 0|1           photo finish mode, data checked after every heat (SMSG_PHOTO, default 0)
+      -v <pct>         photo finish: lane 1 sees each car this much longer (misaligned, default 0)
+      -j 0|1           debug output on (SMSG_DEBUG), serial writes all through the heat (default 0)
+ *================================================================================*/
+#define MS(x)          ((unsigned long long)((x) * (TB_TICKS_PER_SEC / 1000.0) + 0.5))
+#define SIM_NULL_TICKS (9999UL * (TB_TICKS_PER_SEC / 1000))    // NULL_TIME in main.cpp
+#define BEAM_MS        5.0             // time a car blocks the finish beam
+#define LAST_CAR_MS    9500.0          // latest generated arrival (before the timeout)
+#define RESTART_MS     (80 + 30 * NUM_LANES)    // restart this long after the heat (EEPROM copies take ~35 ms a lane)
+#define DEBUG_HOLD_MS  400             // -j 1: a debug line at 9600 baud holds the loop (and the copies) up to 330 ms
+#define REARM_WAIT_MS  3000            // longest wait for the timer to rearm itself (-o 1)
+#define GLITCH_MAX_US  900             // longest generated glitch (GLITCH_US in main.cpp is 1000)
+#define STALL_MS       20.0            // loop stall around a finish (-l), longer than the beam
+#define SIM_CAR_MM     178             // CAR_MM in main.cpp
+#define SPEED_MIN      3.0             // generated heat speed at the line (m/s, -e 1)
+#define SPEED_MAX      6.5
+#define SPEED_CAR      5.0             // cars within this (%) of the heat speed
+#define PHOTO_WAIT_MS  1500            // photo finish data at 9600 baud
+#define RESULT_WAIT_MS 1000            // longest the host waits for late results (-j 1)
+#define READY_WAIT_MS  1000            // longest the host waits for the ready before opening the gate
+
+extern unsigned long lane_time[];
+extern int           lane_place[];
+extern boolean       lane_mask[];
+extern unsigned int  heat_seq;
+extern boolean       fBinary;
+extern boolean       fAuto;
+extern unsigned long serial_baud;
+extern unsigned long reset_magic;
+extern byte          timeout_mode;
+extern byte          dnf_factor;
+extern unsigned long spread_avg;
+extern boolean       fPhoto;
+extern boolean       fDebug;
+extern byte          LANE_DET[];
+extern byte          START_GATE;
+
+void save_reset_cause();
+boolean cold_start();
+void setup();
+void loop();
+unsigned long heat_cutoff(unsigned long leader);
+unsigned int photo_align(byte lane);
+unsigned int photo_overflow(byte lane);
+
+struct lane_stats {
+  unsigned long timed;
+  long          err_max;               // ticks
+  double        err_sum;
+};
+
+struct heat_copy {
+  long time[NUM_LANES];                // 1/10000 s, as reported
+  int  place[NUM_LANES];               // binary frames only
+};
+
+static long reported[NUM_LANES];       // reported time, 1/10000 s (-1 = none)
+static long photo_rep[NUM_LANES][5];   // photo finish line: edges, breaks, us in beam, midpoint us, mm/s
+static bool photo_got[NUM_LANES];
+static unsigned long long results_done;    // tick the last result line left the UART
+
+static pdt::frame_decoder decoder;
+static pdt::heat_result   frame;       // last decoded frame
+static unsigned long      frames_ok, frames_bad;
+static char rx_line[64];
+static int  rx_len = 0;
+
+static bool dumping = false;           // history dump requested
+static long dump_id = -1;              // heat ID of the text lines being read (-1 = live results)
+static std::map<unsigned, heat_copy> dumped;    // heat ID -> dumped results
+static std::map<unsigned, heat_copy> kept;      // heat ID -> results as first reported
+static unsigned long long ready_at;    // tick the last SMSG_READY arrived
+
+
+/*-----------------------------------------*
+  - ticks in 1/10000 s, rounded as the result text is (format_sim checks it) -
+ *-----------------------------------------*/
+static long as_text(unsigned long ticks)
+{
+  char buf[16];
+  unsigned long sec = 0, frac = 0;
+
+
+  sscanf(tb_format(buf, ticks, 4), "%lu.%4lu", &sec, &frac);
+
+  return sec * 10000 + frac;
+}
+
+
+/*================================================================================*
+  COLLECT RESULT LINES FROM THE TIMER
+ *================================================================================*/
+static void sim_sink(uint8_t c)
+{
+  int lane;
+  unsigned long sec, frac;
+
+
+  switch (decoder.feed(c, &frame))
+  {
+    case pdt::FRAME_NONE:
+      break;
+    case pdt::FRAME_OK:
+      if (dumping)
+      {
+        heat_copy &d = dumped[frame.seq];
+        for (int n=0; n<frame.lanes && n<NUM_LANES; n++)
+        {
+          d.time[n]  = as_text(frame.ticks[n] ? frame.ticks[n] : SIM_NULL_TICKS);
+          d.place[n] = frame.place[n];
+        }
+        return;
+      }
+      frames_ok++;
+      for (int n=0; n<frame.lanes && n<NUM_LANES; n++)
+      {
+        reported[n] = as_text(frame.ticks[n] ? frame.ticks[n] : SIM_NULL_TICKS);
+      }
+      results_done = hal_tx_done();
+      return;
+    case pdt::FRAME_BAD:
+      frames_bad++;
+      return;
+    default:
+      return;
+  }
+
+  if (c != '\n')
+  {
+    if (rx_len < (int)sizeof(rx_line) - 1) rx_line[rx_len++] = c;
+    return;
+  }
+
+  rx_line[rx_len] = '\0';
+  rx_len = 0;
+
+  if (rx_line[0] == 'K' && (rx_line[1] == '\r' || !rx_line[1]))
+  {
+    ready_at = hal_now();
+    return;
+  }
+
+  long *ph;
+  if (sscanf(rx_line, "phot=%d,", &lane) == 1 && lane >= 1 && lane <= NUM_LANES)
+  {
+    ph = photo_rep[lane-1];
+    photo_got[lane-1] = sscanf(rx_line, "phot=%*d,%ld,%ld,%ld,%ld,%ld", &ph[0], &ph[1], &ph[2], &ph[3], &ph[4]) == 5;
+    return;
+  }
+
+  if (dumping && sscanf(rx_line, "heat=%lu", &sec) == 1)
+  {
+    dump_id = sec;
+    return;
+  }
+
+  if (sscanf(rx_line, "%d - %lu.%4lu", &lane, &sec, &frac) == 3 && lane >= 1 && lane <= NUM_LANES)
+  {
+    if (dump_id >= 0)
+    {
+      dumped[dump_id].time[lane-1] = sec * 10000 + frac;
+      if (lane == NUM_LANES) dump_id = -1;
+      return;
+    }
+    reported[lane-1] = sec * 10000 + frac;
+    if (lane == NUM_LANES) results_done = hal_tx_done();
+  }
+}
+
+
+/*================================================================================*
+  RUN FIRMWARE UNTIL A VIRTUAL TIME
+ *================================================================================*/
+static void run_until(unsigned long long t)
+{
+  while (hal_now() < t)
+  {
+    loop();
+    hal_advance(1);
+  }
+}
+
+
+/*================================================================================*
+  HOST SETUP - SERIAL BAUD AND RESULT FORMAT
+ *================================================================================*/
+static void host_setup(const char *baud, bool binary, bool autoarm, int tmode, bool photo, bool debug)
+{
+  if (baud)                            // rate code, then confirm at the new rate
+  {
+    char cmd[4];
+    sprintf(cmd, "X%.1s", baud);
+    hal_schedule_serial(hal_now() + MS(10), cmd);
+    hal_schedule_serial(hal_now() + MS(300), "X");
+    run_until(hal_now() + MS(500));
+  }
+  if (binary)
+  {
+    hal_schedule_serial(hal_now() + MS(10), "Y1");
+    run_until(hal_now() + MS(200));
+  }
+  if (tmode)
+  {
+    char cmd[4];
+    sprintf(cmd, "T%d", tmode);
+    hal_schedule_serial(hal_now() + MS(10), cmd);
+    run_until(hal_now() + MS(200));
+  }
+  if (photo)
+  {
+    hal_schedule_serial(hal_now() + MS(10), "E1");
+    run_until(hal_now() + MS(200));
+  }
+  if (debug)
+  {
+    hal_schedule_serial(hal_now() + MS(10), "D");
+    run_until(hal_now() + MS(200));
+  }
+  if (autoarm)                         // last: a restarted timer rearms REARM_CLEAR after this
+  {
+    hal_schedule_serial(hal_now() + MS(10), "A1");
+    run_until(hal_now() + MS(200));
+  }
+}
+
+
+/*================================================================================*
+  RESTART THE TIMER
+
+  Clears what a reset clears (the race state in .bss and the settings the
+  host made; the rest of the firmware's globals are left alone), runs
+  setup() again and has the host set up the link again. A power cycle
+  also loses the .noinit RAM; every other restart comes up with MCUSR
+  cleared, as the Uno's bootloader leaves it, so the timer has only that
+  RAM to tell the two apart.
+ *================================================================================*/
+static void restart(bool power, const char *baud, bool binary, bool autoarm, int tmode, bool photo, bool debug)
+{
+  static unsigned long restarts = 0;
+
+
+  memset(lane_time, 0, sizeof(lane_time[0]) * NUM_LANES);
+  memset(lane_place, 0, sizeof(lane_place[0]) * NUM_LANES);
+  memset(lane_mask, 0, sizeof(lane_mask[0]) * NUM_LANES);
+  heat_seq = 0;
+  fBinary = false;
+  fAuto = false;
+  fPhoto = false;
+  fDebug = false;
+  timeout_mode = 0;
+  dnf_factor = 15;
+  spread_avg = 0;
+  serial_baud = 9600;
+
+  if (power) reset_magic = 0;          // RAM lost
+  MCUSR = restarts++ % 2 ? (power ? _BV(PORF) : _BV(WDRF)) : 0;    // every other one cleared, as Optiboot leaves it
+  save_reset_cause();
+  setup();
+  host_setup(baud, binary, autoarm, tmode, photo, debug);
+}
+
+
+int race_sim(int argc, char *argv[])
+{
+  long heats = 0;
+  unsigned seed = 1;
+  bool uniform = false;
+  double mean_ms = 3000, spread_ms = 150, p_dnf = 2, p_mask = 5, p_tie = 5, p_cmd = 10;
+  unsigned long warp_us = 1000;
+  const char *baud = NULL;
+  bool binary = false;
+  unsigned long frame_errors = 0;
+  double p_warm = 0, p_power = 0;
+  unsigned long warm_resets = 0, power_cycles = 0, restart_wrong = 0;
+  long dump_every = 0;
+  bool autoarm = false;
+  unsigned long rearms = 0, rearm_missed = 0;
+  double rearm_sum = 0, rearm_max = 0;
+  unsigned long long gate_closed = 0;
+  unsigned long dump_checked = 0, dump_missing = 0, dump_wrong = 0;
+  int tmode = 0;
+  unsigned long cut = 0, delivered = 0, dnf_heats = 0;
+  double length_sum = 0, dnf_length_sum = 0;
+  double p_glitch = 0;
+  unsigned long glitches = 0;
+  bool photo = false;
+  bool debug = false;
+  double misalign = 0;
+  double p_stall = 0;
+  unsigned long stalled = 0;
+  double p_near = 0;
+  unsigned long near = 0;
+  unsigned long photo_checked = 0, photo_errors = 0;
+  unsigned long overflows[NUM_LANES] = {};
+  double speed_err_max = 0, mid_err_max = 0;
+
+  lane_stats stats[NUM_LANES] = {};
+  unsigned long mismatches = 0, place_errors = 0, dnfs = 0, masked = 0;
+  long worst_latency = 0;
+  double deliver_sum = 0, deliver_max = 0;
+
+
+  for (int i=1; i+1<argc; i+=2)
+  {
+    if      (!strcmp(argv[i], "-n")) heats = atol(argv[i+1]);
+    else if (!strcmp(argv[i], "-s")) seed = atoi(argv[i+1]);
+    else if (!strcmp(argv[i], "-a")) uniform = !strcmp(argv[i+1], "uniform");
+    else if (!strcmp(argv[i], "-m")) mean_ms = atof(argv[i+1]);
+    else if (!strcmp(argv[i], "-w")) spread_ms = atof(argv[i+1]);
+    else if (!strcmp(argv[i], "-d")) p_dnf = atof(argv[i+1]);
+    else if (!strcmp(argv[i], "-k")) p_mask = atof(argv[i+1]);
+    else if (!strcmp(argv[i], "-i")) p_tie = atof(argv[i+1]);
+    else if (!strcmp(argv[i], "-c")) p_cmd = atof(argv[i+1]);
+    else if (!strcmp(argv[i], "-x")) warp_us = atol(argv[i+1]);
+    else if (!strcmp(argv[i], "-b")) baud = argv[i+1];
+    else if (!strcmp(argv[i], "-f")) binary = atoi(argv[i+1]);
+    else if (!strcmp(argv[i], "-r")) p_warm = atof(argv[i+1]);
+    else if (!strcmp(argv[i], "-p")) p_power = atof(argv[i+1]);
+    else if (!strcmp(argv[i], "-y")) dump_every = atol(argv[i+1]);
+    else if (!strcmp(argv[i], "-o")) autoarm = atoi(argv[i+1]);
+    else if (!strcmp(argv[i], "-t")) tmode = atoi(argv[i+1]);
+    else if (!strcmp(argv[i], "-g")) p_glitch = atof(argv[i+1]);
+    else if (!strcmp(argv[i], "-l")) p_stall = atof(argv[i+1]);
+    else if (!strcmp(argv[i], "-h")) p_near = atof(argv[i+1]);
+    else if (!strcmp(argv[i], "-e")) photo = atoi(argv[i+1]);
+    else if (!strcmp(argv[i], "-v")) misalign = atof(argv[i+1]);
+    else if (!strcmp(argv[i], "-j")) debug = atoi(argv[i+1]);
+  }
+
+  std::mt19937 rng(seed);
+  std::uniform_real_distribution<double> pct(0.0, 100.0);
+  std::normal_distribution<double> normal(mean_ms, spread_ms);
+  std::uniform_real_distribution<double> flat(mean_ms - spread_ms, mean_ms + spread_ms);
+  std::uniform_real_distribution<double> speed(SPEED_MIN, SPEED_MAX);
+
+  hal_set_serial_sink(sim_sink);
+  hal_set_warp(warp_us * TB_TICKS_PER_US);
+  hal_reset_inputs();
+  save_reset_cause();                  // power-on
+  setup();
+  host_setup(baud, binary, autoarm, tmode, photo, debug);
+
+  auto wall_start = std::chrono::steady_clock::now();
+  hal_clear_loop_stats();
+
+  for (long h=0; h<heats; h++)
+  {
+    unsigned long long t, open, heat_end;
+    unsigned long truth[NUM_LANES], beam[NUM_LANES];
+    double mm_s[NUM_LANES];
+    bool glitched[NUM_LANES] = {};
+    bool flicker[NUM_LANES] = {};       // and again as the car clears the beam
+    bool mask[NUM_LANES], dnf[NUM_LANES];
+    int  place[NUM_LANES], unmasked = 0;
+    char cmd[4];
+
+/*-----------------------------------------*
+  - generate heat -
+ *-----------------------------------------*/
+    for (int n=0; n<NUM_LANES; n++)
+    {
+      mask[n] = pct(rng) < p_mask;
+      if (!mask[n]) unmasked++;
+    }
+    if (!unmasked) mask[rng() % NUM_LANES] = false;
+
+    unsigned long last = 0;
+    double heat_speed = speed(rng) * 1000;
+    for (int n=0; n<NUM_LANES; n++)
+    {
+      double a = uniform ? flat(rng) : normal(rng);
+
+      a = max(500.0, min(a, LAST_CAR_MS));
+      dnf[n] = !mask[n] && pct(rng) < p_dnf;
+      truth[n] = mask[n] ? 0 : dnf[n] ? SIM_NULL_TICKS : (unsigned long)MS(a);
+
+      if (n > 0 && !mask[n] && !dnf[n] && pct(rng) < p_tie)    // tie an earlier car
+      {
+        int m = rng() % n;
+        if (!mask[m] && !dnf[m]) truth[n] = truth[m];
+      }
+      if (!mask[n]) last = max(last, truth[n]);
+      reported[n] = -1;
+      photo_got[n] = false;
+
+      mm_s[n] = photo ? heat_speed * (1 + (pct(rng) - 50) / 50 * SPEED_CAR / 100) : SIM_CAR_MM / BEAM_MS * 1000;
+      beam[n] = (unsigned long)MS(SIM_CAR_MM / mm_s[n] * 1000 * (n == 0 ? 1 + misalign / 100 : 1));
+    }
+
+    unsigned long leader = SIM_NULL_TICKS, cutoff;    // the heat timeout the timer will use
+    for (int n=0; n<NUM_LANES; n++) if (!mask[n] && !dnf[n]) leader = min(leader, truth[n]);
+    cutoff = tmode && leader < SIM_NULL_TICKS ? heat_cutoff(leader) : SIM_NULL_TICKS;
+
+    for (int n=0; n<NUM_LANES && tmode; n++)    // just in by the cutoff
+    {
+      if (mask[n] || dnf[n] || truth[n] == leader || cutoff >= SIM_NULL_TICKS || pct(rng) >= p_near) continue;
+      truth[n] = cutoff - rng() % MS(2);
+      last = max(last, truth[n]);
+      near++;
+    }
+
+    results_done = 0;
+    frame.seq = 0;
+
+/*-----------------------------------------*
+  - continuous heats: wait for the timer to rearm -
+ *-----------------------------------------*/
+    if (autoarm && gate_closed)
+    {
+      while (ready_at < gate_closed && hal_now() < gate_closed + MS(REARM_WAIT_MS))
+      {
+        loop();
+        hal_advance(1);
+      }
+      if (ready_at < gate_closed)
+      {
+        rearm_missed++;
+        hal_schedule_serial(hal_now() + MS(10), "R");
+        run_until(hal_now() + MS(100));
+      }
+      else
+      {
+        double ms = (double)(ready_at - gate_closed) / (TB_TICKS_PER_SEC / 1000);
+        rearms++;
+        rearm_sum += ms;
+        rearm_max = max(rearm_max, ms);
+      }
+    }
+
+/*-----------------------------------------*
+  - schedule it on the track -
+ *-----------------------------------------*/
+    t = hal_now() + MS(10);
+    hal_schedule_serial(t, "U");
+    for (int n=0; n<NUM_LANES; n++)
+    {
+      if (!mask[n]) continue;
+      t += MS(20);                     // host waits for the ack
+      sprintf(cmd, "M%d", n+1);
+      hal_schedule_serial(t, cmd);
+    }
+    t += MS(150);
+    open = t + MS(200);
+    if (!autoarm)
+    {
+      hal_schedule_serial(t, "R");
+      while (ready_at < t && hal_now() < t + MS(READY_WAIT_MS))    // debug output can hold up the ready
+      {
+        loop();
+        hal_advance(1);
+      }
+      open = max(open, hal_now() + MS(10));
+    }
+
+    hal_schedule(open, START_GATE, LOW);
+
+    for (int n=0; n<NUM_LANES; n++)
+    {
+      if (mask[n] || dnf[n]) continue;
+      hal_schedule(open + truth[n], LANE_DET[n], HIGH);
+      hal_schedule(open + truth[n] + beam[n], LANE_DET[n], LOW);
+
+      if (pct(rng) < p_stall)          // loop busy from just before the car until after the beam clears
+      {
+        hal_schedule_stall(open + truth[n] - MS(2), MS(STALL_MS));
+        stalled++;
+      }
+    }
+
+    unsigned long first = SIM_NULL_TICKS;    // glitches land before the winner, while the heat runs
+    for (int n=0; n<NUM_LANES; n++) if (!mask[n]) first = min(first, truth[n]);
+
+    for (int n=0; n<NUM_LANES; n++)    // flash or flicker before the cars
+    {
+      if (mask[n] || pct(rng) >= p_glitch) continue;
+
+      unsigned long long at = open + MS(100) + (unsigned long long)(pct(rng) / 100.0 * (first - MS(120)));
+      hal_schedule(at, LANE_DET[n], HIGH);
+      hal_schedule(at + (20 + rng() % (GLITCH_MAX_US - 20)) * TB_TICKS_PER_US, LANE_DET[n], LOW);
+      glitches++;
+      glitched[n] = true;
+
+      if (!photo || dnf[n] || pct(rng) >= 50) continue;
+      at = open + truth[n] + beam[n] + MS(1);
+      hal_schedule(at, LANE_DET[n], HIGH);
+      hal_schedule(at + 50 * TB_TICKS_PER_US, LANE_DET[n], LOW);
+      flicker[n] = true;
+    }
+
+    if (pct(rng) < p_cmd)
+    {
+      hal_schedule_serial(open + (unsigned long long)(pct(rng) / 100.0 * last), "V");
+    }
+
+    heat_end = open + last + MS(150);  // room for the results at 9600 baud
+    hal_schedule(heat_end, START_GATE, HIGH);
+    gate_closed = heat_end;
+
+    run_until(heat_end);
+    while (!results_done && hal_now() < heat_end + MS(RESULT_WAIT_MS))    // debug output holds them up
+    {
+      loop();
+      hal_advance(1);
+    }
+
+/*-----------------------------------------*
+  - restart before the host reads them -
+ *-----------------------------------------*/
+    double r = pct(rng);
+    bool resent = r < p_warm + p_power;
+
+    if (resent)
+    {
+      unsigned long long done = results_done;    // delivery is scored on the first send
+
+      unsigned long hold = RESTART_MS + (debug ? DEBUG_HOLD_MS : 0);
+
+      run_until(max(heat_end, done) + MS(hold));    // the results are out, the copies are not
+      for (int n=0; n<NUM_LANES; n++) reported[n] = -1;
+      frame.seq = 0;
+
+      restart(r >= p_warm, baud, binary, autoarm, tmode, photo, debug);
+      if (r >= p_warm) power_cycles++; else warm_resets++;
+      if (cold_start() != (r >= p_warm)) restart_wrong++;
+
+      results_done = 0;
+      hal_schedule_serial(hal_now() + MS(10), "Q");
+      run_until(hal_now() + MS(150));
+      while (!results_done && hal_now() < done + MS(hold + RESULT_WAIT_MS))
+      {
+        loop();
+        hal_advance(1);
+      }
+      results_done = done;
+    }
+
+/*-----------------------------------------*
+  - score it -
+ *-----------------------------------------*/
+    bool early = false;                // timer gave up on a car still running
+    for (int n=0; n<NUM_LANES; n++)
+    {
+      if (!tmode || mask[n] || dnf[n] || truth[n] <= cutoff || lane_time[n] < SIM_NULL_TICKS) continue;
+      truth[n] = SIM_NULL_TICKS;
+      dnf[n] = early = true;
+      cut++;
+    }
+
+    if (results_done >= open + last && !early)    // last car (or timeout) to results on the wire
+    {
+      double ms = (double)(results_done - open - last) / (TB_TICKS_PER_SEC / 1000);
+      deliver_sum += ms;
+      deliver_max = max(deliver_max, ms);
+      delivered++;
+    }
+    if (results_done)                  // gate open to results on the wire
+    {
+      double ms = (double)(results_done - open) / (TB_TICKS_PER_SEC / 1000);
+      bool any_dnf = false;
+      for (int n=0; n<NUM_LANES; n++) any_dnf |= dnf[n];
+      length_sum += ms;
+      if (any_dnf) { dnf_heats++; dnf_length_sum += ms; }
+    }
+
+    for (int n=0; n<NUM_LANES; n++)    // expected place: 1 + distinct earlier times
+    {
+      place[n] = mask[n] ? 0 : 1;
+      for (int m=0; m<NUM_LANES && !mask[n]; m++)
+      {
+        bool seen = false;
+        for (int k=0; k<m; k++) seen |= !mask[k] && truth[k] == truth[m];
+        if (!mask[m] && !seen && truth[m] < truth[n]) place[n]++;
+      }
+    }
+
+    for (int n=0; n<NUM_LANES; n++)
+    {
+      unsigned long expect = (mask[n] || truth[n] == 0) ? SIM_NULL_TICKS : truth[n];
+
+      if (reported[n] != as_text(expect)) mismatches++;
+      if (binary && (frame.seq != (uint16_t)(h + 1) || (frame.duplicate && !resent) || frame.missed ||
+                     frame.ticks[n] != lane_time[n] || frame.place[n] != lane_place[n] ||
+                     frame.masked(n) != mask[n] || frame.finished(n) != (!mask[n] && !dnf[n]))) frame_errors++;
+      if (lane_place[n] != place[n]) place_errors++;
+
+      if (mask[n]) { masked++; continue; }
+      if (dnf[n])  { dnfs++;   continue; }
+
+      long err = (long)(lane_time[n] - truth[n]);
+      stats[n].timed++;
+      stats[n].err_sum += err;
+      if (labs(err) > labs(stats[n].err_max)) stats[n].err_max = err;
+      worst_latency = max(worst_latency, err);
+    }
+
+/*-----------------------------------------*
+  - photo finish data (not kept across a restart), after the results: the timer may rearm meanwhile -
+ *-----------------------------------------*/
+    if (photo && !resent)
+    {
+      hal_schedule_serial(hal_now() + MS(10), "E");
+      run_until(hal_now() + MS(PHOTO_WAIT_MS));
+    }
+
+    for (int n=0; n<NUM_LANES && photo && !resent; n++)    // cars that finished: one break, at the truth
+    {
+      if (mask[n] || dnf[n]) continue;
+
+      long *ph = photo_rep[n];
+      double mid_err = fabs(ph[3] - (truth[n] + beam[n] / 2.0) / TB_TICKS_PER_US);
+      double speed_err = n == 0 && misalign ? 0 : fabs(ph[4] - mm_s[n]) / mm_s[n] * 100;
+
+      photo_checked++;
+      if (2 * (1 + glitched[n] + flicker[n]) > PHOTO_EDGES) overflows[n]++;
+      if (!photo_got[n] || ph[0] != 2 * (1 + glitched[n] + flicker[n]) || ph[1] != 1 + glitched[n] + flicker[n] ||
+          mid_err > 1.0 || speed_err > 0.5) photo_errors++;
+      mid_err_max = max(mid_err_max, mid_err);
+      speed_err_max = max(speed_err_max, speed_err);
+    }
+
+/*-----------------------------------------*
+  - check the history now and then -
+ *-----------------------------------------*/
+    heat_copy &k = kept[h + 1];        // heat IDs count from 1
+    for (int n=0; n<NUM_LANES; n++)
+    {
+      k.time[n]  = reported[n];
+      k.place[n] = lane_place[n];
+    }
+
+    if (dump_every && (h + 1) % dump_every == 0)
+    {
+      unsigned first = max(1L, h + 2 - dump_every), last = h + 1;
+      char tmps[24];
+
+      dumped.clear();
+      dumping = true;
+      sprintf(tmps, "<Q%u,%u>", first, last);
+      hal_schedule_serial(hal_now() + MS(10), tmps);
+      run_until(hal_now() + MS(100) * dump_every + MS(300));
+      dumping = false;
+
+      for (unsigned id=first; id<=last; id++)
+      {
+        if (!dumped.count(id)) { dump_missing++; continue; }
+        dump_checked++;
+        for (int n=0; n<NUM_LANES; n++)
+        {
+          if (dumped[id].time[n] != kept[id].time[n] || (binary && dumped[id].place[n] != kept[id].place[n]))
+          {
+            dump_wrong++;
+            break;
+          }
+        }
+      }
+    }
+  }
+
+  double wall = std::chrono::duration<double>(std::chrono::steady_clock::now() - wall_start).count();
+  unsigned long polls, poll_max;
+  unsigned long long poll_total;
+  hal_loop_stats(&polls, &poll_max, &poll_total);
+
+/*-----------------------------------------*
+  - report -
+ *-----------------------------------------*/
+  printf("heats            %ld (seed %u, %s %.0f +/- %.0f ms, warp %lu us)\n", heats, seed,
+         uniform ? "uniform" : "normal", mean_ms, spread_ms, warp_us);
+  printf("result errors    %lu reported times, %lu places (dnf %lu, masked %lu)\n",
+         mismatches, place_errors, dnfs, masked);
+  printf("lane   timed   max err us   mean err us\n");
+  for (int n=0; n<NUM_LANES; n++)
+  {
+    printf("%4d %7lu %12.1f %13.3f\n", n+1, stats[n].timed,
+           stats[n].err_max / (double)TB_TICKS_PER_US,
+           stats[n].timed ? stats[n].err_sum / stats[n].timed / TB_TICKS_PER_US : 0.0);
+  }
+  printf("detect latency   %.1f us worst case\n", worst_latency / (double)TB_TICKS_PER_US);
+  if (binary)
+  {
+    printf("binary frames    %lu decoded, %lu rejected, %lu lane fields wrong\n", frames_ok, frames_bad, frame_errors);
+  }
+  if (p_warm || p_power)
+  {
+    unsigned long writes, max_cell;
+    hal_eeprom_stats(&writes, &max_cell);
+    printf("restarts         %lu warm, %lu power cycles (results resent after each), %lu taken for the other kind\n",
+           warm_resets, power_cycles, restart_wrong);
+    if (restart_wrong) mismatches++;
+    printf("eeprom           %lu bytes written, %lu writes to the busiest byte\n", writes, max_cell);
+  }
+  if (p_glitch)
+  {
+    unsigned long rejected = 0;
+    for (int n=0; n<NUM_LANES; n++) rejected += capture_glitches(n);
+    printf("glitches         %lu generated, %lu rejected by the timer\n", glitches, rejected);
+    if (rejected != glitches) mismatches++;
+  }
+  if (p_near)
+  {
+    printf("near cutoff      %lu cars crossed in the last 2 ms before the heat timeout\n", near);
+  }
+  if (p_stall)
+  {
+    printf("loop stalls      %lu cars crossed while the loop was stuck for %.0f ms\n", stalled, STALL_MS);
+  }
+  unsigned long disp_edges, disp_wait, ser_edges, ser_wait;
+  hal_work_stats(&disp_edges, &disp_wait, &ser_edges, &ser_wait);
+  printf("busy edges       %lu during display writes (up to %.1f us before the write ended), %lu during serial writes (%.1f us)%s\n",
+         disp_edges, disp_wait / (double)TB_TICKS_PER_US, ser_edges, ser_wait / (double)TB_TICKS_PER_US,
+         debug ? ", debug on" : "");
+  if (photo)
+  {
+    printf("photo finish     %lu cars checked, %lu wrong, %.2f%% worst speed, %.1f us worst midpoint\n",
+           photo_checked, photo_errors, speed_err_max, mid_err_max);
+    printf("lane alignment  ");
+    for (int n=0; n<NUM_LANES; n++) printf(" L%d %.1f%%", n+1, photo_align(n) / 10.0);
+    printf(" (time in beam vs heat mean, lane 1 %+.1f%%)\n", misalign);
+    printf("edges dropped   ");
+    for (int n=0; n<NUM_LANES; n++)
+    {
+      printf(" L%d %u/%lu", n+1, photo_overflow(n), overflows[n]);
+      if (!p_warm && !p_power && photo_overflow(n) != overflows[n]) mismatches++;
+    }
+    printf(" heats (timer/sim, more than %d edges)\n", PHOTO_EDGES);
+  }
+  if (autoarm)
+  {
+    printf("rearm            %lu automatic, %.1f ms mean, %.1f ms max (gate closed to ready), %lu missed\n",
+           rearms, rearms ? rearm_sum / rearms : 0.0, rearm_max, rearm_missed);
+  }
+  if (dump_every)
+  {
+    printf("history dumps    %lu heats checked, %lu missing, %lu wrong (last %ld every %ld heats)\n",
+           dump_checked, dump_missing, dump_wrong, dump_every, dump_every);
+  }
+  printf("result delivery  %.2f ms mean, %.2f ms max (last finish to last result byte sent)\n",
+         delivered ? deliver_sum / delivered : 0.0, deliver_max);
+  printf("heat length      %.0f ms mean, %.0f ms mean with a DNF (%lu heats), %lu cars cut early (timeout mode %d)\n",
+         heats ? length_sum / heats : 0.0, dnf_heats ? dnf_length_sum / dnf_heats : 0.0, dnf_heats, cut, tmode);
+  printf("loop period      %.1f us mean, %.1f us max (virtual, between serial polls)\n",
+         polls ? poll_total / (double)polls / TB_TICKS_PER_US : 0.0, poll_max / (double)TB_TICKS_PER_US);
+  unsigned long wdt_gap, wdt_timeouts;
+  hal_wdt_stats(&wdt_gap, &wdt_timeouts);
+  printf("watchdog         %.1f ms longest between resets, %lu timeouts\n",
+         wdt_gap / (double)(TB_TICKS_PER_SEC / 1000), wdt_timeouts);
+  printf("tasks            %u dropped (no free slot)\n", task_dropped());
+  unsigned long runs = hal_loop_runs();
+  printf("host time        %.3f s, %.0f heats/s, %.1f ns per loop pass run (%lu run, %lu skipped by the warp)\n",
+         wall, heats / wall, runs ? wall * 1e9 / runs : 0.0, runs, polls > runs ? polls - runs : 0);
+
+  return (mismatches || place_errors || photo_errors || frame_errors || frames_bad || dump_missing || dump_wrong || rearm_missed ||
+          task_dropped()) ? 1 : 0;
+}
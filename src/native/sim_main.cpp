@@ -0,0 +1,73 @@
+#include <Arduino.h>
+#include "hal_native.h"
+
+/*================================================================================*
+  NATIVE SIMULATOR ENTRY POINT
+
+  Runs the real setup()/loop() against a scripted track (see hal_native.h).
+  Serial output from the timer goes to stdout, a summary to stderr.
+
+    usage: program [-t] [-w] [script]     -t prefixes output lines with virtual time
+                                          -w starts warm (external reset, not power-on)
+           program -n <heats> ...      synthetic heats, see race_sim.cpp
+           program -q <commands> ...   command stream check, see cmd_sim.cpp
+           program -u <heats> ...      racing loop microbenchmark, see bench_sim.cpp
+           program -z <frames> ...     result frame round trip fuzz, see frame_sim.cpp
+           program -p <digits> ...     time format check, see format_sim.cpp
+           program -k <heats> ...      race engine check, see engine_sim.cpp
+           program -d <frames> ...     display bus benchmark, see display_sim.cpp
+ *================================================================================*/
+#define LOOP_COST  1                   // virtual ticks charged per loop() pass
+
+void setup();
+void loop();
+void save_reset_cause();
+int  race_sim(int argc, char *argv[]);
+int  cmd_sim(int argc, char *argv[]);
+int  bench_sim(int argc, char *argv[]);
+int  frame_sim(int argc, char *argv[]);
+int  format_sim(int argc, char *argv[]);
+int  engine_sim(int argc, char *argv[]);
+int  display_sim(int argc, char *argv[]);
+
+int main(int argc, char *argv[])
+{
+  FILE *f = stdin;
+
+
+  if (argc > 1 && !strcmp(argv[1], "-n")) return race_sim(argc, argv);
+  if (argc > 1 && !strcmp(argv[1], "-q")) return cmd_sim(argc, argv);
+  if (argc > 1 && !strcmp(argv[1], "-u")) return bench_sim(argc, argv);
+  if (argc > 1 && !strcmp(argv[1], "-z")) return frame_sim(argc, argv);
+  if (argc > 1 && !strcmp(argv[1], "-p")) return format_sim(argc, argv);
+  if (argc > 1 && !strcmp(argv[1], "-k")) return engine_sim(argc, argv);
+  if (argc > 1 && !strcmp(argv[1], "-d")) return display_sim(argc, argv);
+
+  for (int i=1; i<argc; i++)
+  {
+    if (!strcmp(argv[i], "-t"))
+    {
+      hal_set_timestamps(true);
+    }
+    else if (!strcmp(argv[i], "-w"))    // reset button on a timer already running (RAM kept)
+    {
+      save_reset_cause();
+      MCUSR = _BV(EXTRF);
+    }
+    else if (!(f = fopen(argv[i], "r")))
+    {
+      fprintf(stderr, "sim: cannot open %s\n", argv[i]);
+      return 1;
+    }
+  }
+
+  hal_load_script(f);
+  save_reset_cause();                  // .init3 on the Uno
+
+  setup();
+  for (;;)
+  {
+    loop();
+    hal_advance(LOOP_COST);
+  }
+}
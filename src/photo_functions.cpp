@@ -0,0 +1,126 @@
+#include "photo_functions.h"
+#include "timebase_functions.h"
+
+/*================================================================================*
+  PHOTO FINISH
+
+  From the edges the capture ISR kept on a lane in photo finish mode (beam
+  break, restore, break ...), the car's pass is the first break that held
+  for the glitch filter's minimum pulse, the same one that gave the lane
+  its finish time. Its length is the time the car was in the beam, the car
+  length over that is its speed at the line, and the middle of it is a
+  finish estimate that does not depend on where the nose of the car is.
+
+  Over a session every car runs every lane, so each lane's time in the
+  beam, as a share of the heat's mean, should average out to the same.
+  A lane that stays long or short (beam not square to the track, a sensor
+  that sees the car late) or keeps breaking more than once shows up in
+  photo_align() and photo_chatter(). Only the first PHOTO_EDGES edges of
+  a lane are kept; photo_overflow() counts the heats that had more.
+ *================================================================================*/
+unsigned int align_avg[PHOTO_LANES];   // rolling mean of time in the beam, 1000 = heat mean (0 = no heats)
+unsigned int chatter  [PHOTO_LANES];   // heats with more than one beam break
+unsigned int overflow [PHOTO_LANES];   // heats with more edges than PHOTO_EDGES
+
+
+/*================================================================================*
+  DERIVE A LANE'S PASS FROM ITS EDGES
+ *================================================================================*/
+void photo_lane_data(const unsigned long edge[], byte count, unsigned long start, unsigned long min_ticks,
+                     unsigned int car_mm, photo_lane *pl)
+{
+  byte kept = min(count, (byte)PHOTO_EDGES);
+  unsigned long len;
+
+
+  memset(pl, 0, sizeof(*pl));
+  pl->edges   = count;
+  pl->dropped = count - kept;
+  pl->breaks = (count + 1) / 2;
+
+  for (byte i=0; i<kept && !pl->found; i+=2)    // even = break, odd = restore
+  {
+    len = (i + 1 < kept) ? edge[i+1] - edge[i] : 0;
+    if (i + 1 < kept && len < min_ticks) continue;    // glitch
+
+    pl->found = true;
+    pl->brk = edge[i] - start;
+    if (!len) break;                   // still blocked (or the restore was not kept)
+
+    pl->blocked = len;
+    pl->mid     = pl->brk + len / 2;
+    pl->speed   = (unsigned long)car_mm * TB_TICKS_PER_SEC / len;
+  }
+
+  return;
+}
+
+
+/*================================================================================*
+  ADD A HEAT TO THE LANE ALIGNMENT (lanes not timed have edges = 0)
+ *================================================================================*/
+void photo_heat(const photo_lane pl[], int num_lanes)
+{
+  unsigned long sum = 0, unit, share;
+  int timed = 0;
+
+
+  num_lanes = min(num_lanes, PHOTO_LANES);
+
+  for (int n=0; n<num_lanes; n++)
+  {
+    if (pl[n].breaks > 1) chatter[n]++;
+    if (pl[n].dropped) overflow[n]++;
+    if (!pl[n].blocked) continue;
+
+    sum += pl[n].blocked;
+    timed++;
+  }
+  if (timed < 2) return;               // nothing to compare with
+
+  unit = max(sum / timed / 1000, 1UL);
+
+  for (int n=0; n<num_lanes; n++)
+  {
+    if (!pl[n].blocked) continue;
+
+    share = min(pl[n].blocked / unit, 9999UL);
+    if (!align_avg[n])
+    {
+      align_avg[n] = share;
+    }
+    else
+    {
+      align_avg[n] = align_avg[n] - align_avg[n] / 8 + share / 8;    // rolling mean, 1/8 weight
+    }
+  }
+
+  return;
+}
+
+
+/*================================================================================*
+  LANE ALIGNMENT (time in the beam, 1000 = heat mean, 0 = no heats)
+ *================================================================================*/
+unsigned int photo_align(byte lane)
+{
+  return lane < PHOTO_LANES ? align_avg[lane] : 0;
+}
+
+
+/*================================================================================*
+  LANE CHATTER (heats with more than one beam break)
+ *================================================================================*/
+unsigned int photo_chatter(byte lane)
+{
+  return lane < PHOTO_LANES ? chatter[lane] : 0;
+}
+
+
+/*================================================================================*
+  LANE EDGE OVERFLOW (heats with edges past PHOTO_EDGES, not kept)
+ *================================================================================*/
+unsigned int photo_overflow(byte lane)
+{
+  return lane < PHOTO_LANES ? overflow[lane] : 0;
+}
@@ -0,0 +1,25 @@
+#ifndef PHOTO_VARS_H
+#define PHOTO_VARS_H
+
+#include <Arduino.h>
+#include "capture_functions.h"         // PHOTO_LANES, PHOTO_EDGES
+
+struct photo_lane {
+  byte          edges;                 // edges seen (more than PHOTO_EDGES are counted, not kept)
+  byte          dropped;               // edges seen but not kept (past PHOTO_EDGES)
+  byte          breaks;                // beam breaks (1 = clean pass)
+  boolean       found;                 // car's break found (the first one held for min_ticks)
+  unsigned long brk;                   // car's beam break (timebase ticks from the start)
+  unsigned long blocked;               // car's break to restore (ticks, 0 = not restored)
+  unsigned long mid;                   // midpoint of the car's break (ticks from the start, 0 = not restored)
+  unsigned long speed;                 // at the line, car length / blocked (mm/s, 0 = unknown)
+};
+
+void photo_lane_data(const unsigned long edge[], byte count, unsigned long start, unsigned long min_ticks,
+                     unsigned int car_mm, photo_lane *pl);
+void photo_heat(const photo_lane pl[], int num_lanes);
+unsigned int photo_align(byte lane);
+unsigned int photo_chatter(byte lane);
+unsigned int photo_overflow(byte lane);
+
+#endif //PHOTO_VARS_H
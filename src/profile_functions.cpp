@@ -0,0 +1,74 @@
+#include "profile_functions.h"
+
+#ifdef ENABLE_PROFILE
+/*================================================================================*
+  RACING LOOP PROFILE
+
+  Per-section min/max and log2 histograms of the time spent in each part of
+  the racing loop, in 0.5 us timebase ticks. Bucket n counts durations of
+  2^n to 2^(n+1)-1 ticks (bucket 0 also holds zero).
+ *================================================================================*/
+const char *prof_name[PROF_SECTIONS] = {"LOOP", "UPDATE", "SERVICE", "SERIAL", "SWITCH"};
+const byte prof_nibble[16] = {0, 0, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3};
+
+prof_section prof[PROF_SECTIONS];
+
+
+/*================================================================================*
+  SEND PROFILE TO COMPUTER (and start a new one)
+ *================================================================================*/
+void send_profile()
+{
+  char tmps[64];
+  unsigned long total;
+
+
+  Serial.println(F("-----------------------------"));
+  Serial.println(F(" RACE LOOP PROFILE (us)"));
+  Serial.println(F("-----------------------------"));
+
+  for (int s=0; s<PROF_SECTIONS; s++)
+  {
+    total = 0;
+    for (int b=0; b<PROF_BUCKETS; b++) total += prof[s].bucket[b];
+    if (!total) continue;
+
+    sprintf_P(tmps, PSTR("  %-8s n=%lu min=%u max=%u"), prof_name[s], total,
+              prof[s].min / TB_TICKS_PER_US, prof[s].max / TB_TICKS_PER_US);
+    Serial.println(tmps);
+
+    for (int b=0; b<PROF_BUCKETS; b++)
+    {
+      if (!prof[s].bucket[b]) continue;
+      sprintf_P(tmps, PSTR("    < %5lu  %u"), (2UL << b) / TB_TICKS_PER_US, prof[s].bucket[b]);
+      Serial.println(tmps);
+    }
+  }
+
+  Serial.println(F("-----------------------------"));
+
+  clear_profile();
+
+  return;
+}
+
+
+/*================================================================================*
+  CLEAR PROFILE
+ *================================================================================*/
+void clear_profile()
+{
+  memset(prof, 0, sizeof(prof));
+  for (int s=0; s<PROF_SECTIONS; s++) prof[s].min = 0xFFFF;
+
+  return;
+}
+
+#else
+void send_profile()
+{
+  Serial.println(F("profile not enabled"));
+}
+
+void clear_profile() {}
+#endif
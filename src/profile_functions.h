@@ -0,0 +1,63 @@
+#ifndef PROFILE_VARS_H
+#define PROFILE_VARS_H
+
+#include <Arduino.h>
+#include "timebase_functions.h"
+
+//#define ENABLE_PROFILE 1             // racing loop timing histograms (SMSG_PROF)
+
+#define PROF_LOOP      0               // one pass of the racing loop
+#define PROF_UPDATE    1               // update_display() for a finished lane
+#define PROF_SERVICE   2               // display scheduler slices
+#define PROF_SERIAL    3               // get_serial_data()
+#define PROF_SWITCH    4               // digitalRead(RESET_SWITCH)
+#define PROF_SECTIONS  5
+#define PROF_BUCKETS   16              // log2 buckets of 0.5 us ticks
+
+#ifdef ENABLE_PROFILE
+
+#ifdef NATIVE
+#define PROF_NOW()     ((unsigned int)tb_ticks())
+#else
+#define PROF_NOW()     TCNT1           // Timer1 free-runs at 0.5 us, see timebase_functions
+#endif
+
+struct prof_section {
+  unsigned int min, max;
+  unsigned int bucket[PROF_BUCKETS];   // saturating counts
+};
+
+extern prof_section prof[PROF_SECTIONS];
+extern const byte prof_nibble[16];
+
+/*
+  Record one measurement: a 16-bit subtraction, two compares and a
+  nibble-table log2, so the probe itself costs only a few cycles.
+*/
+inline void prof_record(byte sec, unsigned int d)
+{
+  prof_section *p = &prof[sec];
+  byte b = 0;
+  unsigned int v = d;
+
+  if (d < p->min) p->min = d;
+  if (d > p->max) p->max = d;
+
+  if (v >> 8) { b = 8; v >>= 8; }
+  if (v >> 4) { b += 4; v >>= 4; }
+  b += prof_nibble[v];
+
+  if (p->bucket[b] != 0xFFFF) p->bucket[b]++;
+}
+
+#define PROF_START(v)       unsigned int v = PROF_NOW()
+#define PROF_END(sec, v)    prof_record(sec, PROF_NOW() - v)
+#else
+#define PROF_START(v)
+#define PROF_END(sec, v)
+#endif
+
+void send_profile();
+void clear_profile();
+
+#endif //PROFILE_VARS_H
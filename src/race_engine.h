@@ -0,0 +1,149 @@
+#ifndef RACE_ENGINE_H
+#define RACE_ENGINE_H
+
+#include <Arduino.h>
+
+/*================================================================================*
+  RACE ENGINE
+
+  The finish logic of a heat - placing cars as they cross and giving up on
+  lanes at the timeout - for a lane count fixed at compile time. Lane sets
+  are bit masks (bit n = lane n): a capture event's lanes are masked with
+  the lanes still running, and every lane left in the result gets the one
+  timestamp and the one place, so cars that cross together tie by
+  construction. each_lane<> unrolls the per-lane loops, and a racing loop
+  pass with no finish costs one mask test and, with a timeout, one compare.
+
+  The timer is the derived class (CRTP) and supplies, without virtual calls:
+    void lane_done(byte lane, boolean timeout)       lane has its time and place
+    unsigned long cutoff(unsigned long leader)       timeout once the winner is in
+    unsigned int held(unsigned long by)              lanes that crossed by then (timebase
+                                                     ticks) but are not confirmed yet: the
+                                                     timeout waits for them
+
+  Only the lane count is a template parameter. The pin map and the display
+  backend (LED_DISPLAY, MATRIX_DISPLAY, DUAL_DISP, DUAL_MODE, LARGE_DISP)
+  are still #defines in main.cpp; the engine reaches the displays only
+  through lane_done().
+
+    usage: class Race : public RaceEngine<Race, NUM_LANES, NULL_TICKS> {...};
+ *================================================================================*/
+template <byte N>
+struct each_lane {                     // f(0) ... f(N-1), unrolled
+  template <class F> static inline __attribute__((always_inline)) void run(F f)
+  {
+    each_lane<N - 1>::run(f);
+    f(N - 1);
+  }
+};
+
+template <>
+struct each_lane<0> {
+  template <class F> static inline __attribute__((always_inline)) void run(F) {}
+};
+
+template <boolean Byte> struct lane_word       { typedef uint16_t type; };
+template <>             struct lane_word<true> { typedef uint8_t  type; };
+
+
+template <class Timer, byte Lanes, unsigned long NullTicks>
+class RaceEngine
+{
+  static_assert(Lanes >= 1 && Lanes <= 16, "RaceEngine: 1 to 16 lanes");
+
+public:
+  typedef typename lane_word<(Lanes <= 8)>::type lane_bits;
+
+  static constexpr lane_bits ALL_LANES = (lane_bits)((1UL << Lanes) - 1);
+  static constexpr lane_bits lane_bit(byte n) { return (lane_bits)(1U << n); }
+
+  constexpr RaceEngine(unsigned long *time, int *place, const boolean *mask)
+    : time(time), place(place), mask(mask), left(0), order(0), t_start(0), last(0), lead(0), cut(NullTicks) {}
+
+/*-----------------------------------------*
+  - new heat: every unmasked lane is running -
+ *-----------------------------------------*/
+  void start(unsigned long start_time)
+  {
+    lane_bits run = ALL_LANES;
+
+    each_lane<Lanes>::run([&](byte n) { if (mask[n]) run &= ~lane_bit(n); });
+
+    left    = run;
+    order   = 0;
+    t_start = start_time;
+    last    = 0;
+    lead    = 0;
+    cut     = NullTicks;
+  }
+
+/*-----------------------------------------*
+  - cars crossed the finish line (false = all masked or already in) -
+ *-----------------------------------------*/
+  boolean finish(unsigned int lanes, unsigned long now)
+  {
+    lane_bits done = lanes & left;
+    unsigned long t = now - t_start;
+
+
+    if (!done) return false;
+
+    if (!lead)
+    {
+      lead = t;
+      cut  = timer()->cutoff(lead);
+    }
+    finish_lanes(done, t, false);
+
+    return true;
+  }
+
+/*-----------------------------------------*
+  - lanes still running at the cutoff get NullTicks (once those held from before it are in) -
+ *-----------------------------------------*/
+  void check_timeout(unsigned long now)
+  {
+    if (!left || (now - t_start) <= cut || (left & timer()->held(t_start + cut))) return;
+
+    finish_lanes(left, NullTicks, true);
+  }
+
+  void          end()                  { left = 0; }    // forced end, unfinished lanes stay 0
+  lane_bits     running() const        { return left; }
+  unsigned long leader() const         { return lead; }
+  unsigned long last_finish() const    { return last; }
+
+private:
+  Timer *timer()                       { return static_cast<Timer *>(this); }
+
+  void finish_lanes(lane_bits done, unsigned long t, boolean timeout)
+  {
+    if (t > last)                      // one place for the whole set (ties share a place)
+    {
+      order++;
+      last = t;
+    }
+    left &= ~done;
+
+    each_lane<Lanes>::run([&](byte n)
+    {
+      if (!(done & lane_bit(n))) return;
+
+      time[n]  = t;
+      place[n] = order;
+      timer()->lane_done(n, timeout);
+    });
+  }
+
+  unsigned long *time;                 // lane finish time (timebase ticks)
+  int           *place;                // lane finish place
+  const boolean *mask;                 // lane mask status
+  lane_bits      left;                 // lanes still running
+  int            order;                // places handed out
+  unsigned long  t_start;              // heat start (timebase ticks)
+  unsigned long  last;                 // latest finish time so far
+  unsigned long  lead;                 // winner's time (0 = none yet)
+  unsigned long  cut;                  // heat timeout (ticks from start)
+};
+
+#endif //RACE_ENGINE_H
@@ -0,0 +1,56 @@
+#include "ram_functions.h"
+
+/*================================================================================*
+  RAM USE
+
+  The globals (.data, .bss and .noinit) run from __data_start up to
+  __heap_start; the timer has no heap, so the rest of the Uno's 2 KB up to
+  the stack pointer is free. In .init3, before anything is on the stack,
+  that gap is painted with RAM_PAINT. The stack only ever grows down into
+  it, so the paint left above __heap_start is the least free RAM since
+  the reset (a stack byte that happens to equal RAM_PAINT can add one).
+ *================================================================================*/
+#define RAM_PAINT      0xA5
+
+#ifndef NATIVE
+extern char __data_start, __heap_start;    // from the linker script
+
+void ram_paint() __attribute__ ((naked, used, section (".init3")));
+
+void ram_paint()
+{
+  for (byte *p = (byte *)&__heap_start; p < (byte *)(uintptr_t)SP; p++) *p = RAM_PAINT;
+}
+#endif
+
+
+/*================================================================================*
+  STATIC RAM (bytes)
+ *================================================================================*/
+unsigned int ram_static()
+{
+#ifndef NATIVE
+  return &__heap_start - &__data_start;
+#else
+  return 0;
+#endif
+}
+
+
+/*================================================================================*
+  LEAST FREE RAM SINCE RESET (bytes)
+ *================================================================================*/
+unsigned int ram_free()
+{
+#ifndef NATIVE
+  const byte *p = (const byte *)&__heap_start;
+  unsigned int n = 0;
+
+
+  while (p + n < (const byte *)(uintptr_t)SP && p[n] == RAM_PAINT) n++;
+
+  return n;
+#else
+  return 0;
+#endif
+}
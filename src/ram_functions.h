@@ -0,0 +1,9 @@
+#ifndef RAM_VARS_H
+#define RAM_VARS_H
+
+#include <Arduino.h>
+
+unsigned int ram_static();             // .data + .bss + .noinit (bytes, 0 on the host)
+unsigned int ram_free();               // least free RAM between the globals and the stack since reset (bytes)
+
+#endif //RAM_VARS_H
@@ -0,0 +1,50 @@
+#include <avr/wdt.h>
+#include "reset_functions.h"
+
+/*================================================================================*
+  RESET CAUSE
+
+  MCUSR is copied in .init3, before the Arduino core starts, and cleared so
+  the next reset reports only its own cause. The Uno's Optiboot clears
+  MCUSR itself before it starts the sketch; newer builds leave the value
+  they found in r2, which is used when MCUSR reads 0.
+
+  Neither can be relied on, so a running timer also leaves RESET_MAGIC in
+  .noinit RAM, which the C runtime does not clear. RAM that still holds it
+  has not lost power: the reset was warm whatever MCUSR says. The watchdog
+  is turned off here too: after a watchdog reset it stays on at its
+  shortest timeout until WDRF is cleared.
+ *================================================================================*/
+#define RESET_MAGIC    0x50574454UL    // "PWDT"
+
+byte          reset_cause __attribute__ ((section (".noinit")));
+boolean       reset_ram   __attribute__ ((section (".noinit")));    // RESET_MAGIC survived the reset
+unsigned long reset_magic __attribute__ ((section (".noinit")));
+
+#ifndef NATIVE
+void save_reset_cause() __attribute__ ((naked, used, section (".init3")));
+#endif
+
+void save_reset_cause()
+{
+  byte boot = 0;
+
+
+#ifndef NATIVE
+  asm volatile ("mov %0, r2" : "=r" (boot));    // Optiboot's copy of MCUSR
+#endif
+  reset_cause = MCUSR ? MCUSR : boot & (_BV(WDRF) | _BV(BORF) | _BV(EXTRF) | _BV(PORF));
+  MCUSR = 0;
+  reset_ram   = (reset_magic == RESET_MAGIC);
+  reset_magic = RESET_MAGIC;
+  wdt_disable();
+}
+
+
+/*================================================================================*
+  POWER-ON RESET (or RAM lost) - anything else is a warm reset
+ *================================================================================*/
+boolean cold_start()
+{
+  return (reset_cause & _BV(PORF)) || !reset_ram;
+}
@@ -0,0 +1,14 @@
+#ifndef RESET_VARS_H
+#define RESET_VARS_H
+
+#include <Arduino.h>
+
+extern byte    reset_cause;            // MCUSR at reset (PORF, EXTRF, BORF, WDRF bits, 0 = not known)
+extern boolean reset_ram;              // RAM kept over the reset (warm)
+
+#ifdef NATIVE
+void save_reset_cause();               // .init3 on the Uno
+#endif
+boolean cold_start();
+
+#endif //RESET_VARS_H
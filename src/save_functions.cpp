@@ -0,0 +1,153 @@
+#include <stddef.h>
+#include <EEPROM.h>
+#include "save_functions.h"
+#include "frame_functions.h"           // frame_crc()
+
+/*================================================================================*
+  SAVED RACE STATE
+
+  The last heat (times, places, masks, sequence number) is kept in a .noinit
+  RAM copy that the C runtime does not clear, so it survives a watchdog,
+  brownout or reset-button restart. A CRC-16 (as in result frames) tells a
+  good copy from the garbage left by a power-on.
+
+  Each save is also mirrored to EEPROM by save_service(), one byte per call
+  and only when the EEPROM is ready, so loop() never waits the 3.4 ms a byte
+  write takes. Saves go to SAVE_EE_SLOTS slots in turn and the newest valid
+  slot wins, so no cell is written by every save and a write cut short by
+  a power loss leaves the previous save in place. Saves made while a copy
+  is being written are merged into the next one.
+ *================================================================================*/
+struct saved_heat {                    // fixed widths: same 48 bytes on the Uno and the host
+  uint32_t      time[SAVE_LANES];      // finish time (timebase ticks)
+  uint16_t      gen;                   // save count (newest slot wins)
+  uint16_t      seq;                   // heat sequence number
+  uint8_t       held;                  // results not yet reset by the host
+  uint8_t       mask;                  // masked lanes (bit per lane)
+  uint8_t       place[SAVE_LANES];     // finish place
+  uint16_t      crc;                   // of everything above
+};
+
+#define SAVE_CRC_LEN   ((int)offsetof(saved_heat, crc))
+
+saved_heat heat_ram __attribute__ ((section (".noinit")));    // survives a warm reset
+saved_heat heat_ee;                    // copy being written to EEPROM
+int        ee_slot = 0;                // slot being (or next to be) written
+int        ee_pos = -1;                // next byte of heat_ee to write (-1 = idle)
+boolean    ee_dirty = false;           // heat_ram saved since heat_ee was taken
+
+
+/*-----------------------------------------*
+  - copy is intact -
+ *-----------------------------------------*/
+boolean heat_valid(const saved_heat *h)
+{
+  return frame_crc((const byte *)h, SAVE_CRC_LEN) == h->crc;
+}
+
+
+/*================================================================================*
+  SAVE HEAT (held = results not yet reset by the host)
+ *================================================================================*/
+void save_heat(unsigned int seq, int num_lanes, const unsigned long lane_time[], const int lane_place[],
+               const boolean lane_mask[], boolean held)
+{
+  uint16_t gen = heat_ram.gen + 1;
+
+
+  memset(&heat_ram, 0, sizeof(heat_ram));
+  heat_ram.gen  = gen;
+  heat_ram.seq  = seq;
+  heat_ram.held = held;
+
+  for (int n=0; n<num_lanes && n<SAVE_LANES; n++)
+  {
+    if (lane_mask[n]) heat_ram.mask |= _BV(n);
+    heat_ram.time[n]  = lane_time[n];
+    heat_ram.place[n] = lane_place[n];
+  }
+  heat_ram.crc = frame_crc((const byte *)&heat_ram, SAVE_CRC_LEN);
+
+  ee_dirty = true;
+
+  return;
+}
+
+
+/*================================================================================*
+  RESTORE HEAT (RAM copy if use_ram and intact, else the newest EEPROM slot)
+ *================================================================================*/
+byte restore_heat(boolean use_ram, unsigned int *seq, int num_lanes, unsigned long lane_time[],
+                  int lane_place[], boolean lane_mask[], boolean *held)
+{
+  saved_heat h;
+  int newest = -1;
+  uint16_t newest_gen = 0;
+  byte from = SAVE_RAM;
+
+
+  for (int s=0; s<SAVE_EE_SLOTS; s++)
+  {
+    EEPROM.get(SAVE_EE_BASE + s * sizeof(saved_heat), h);
+    if (!heat_valid(&h)) continue;
+    if (newest < 0 || (int16_t)(h.gen - newest_gen) > 0)
+    {
+      newest = s;
+      newest_gen = h.gen;
+    }
+  }
+  ee_slot = (newest + 1) % SAVE_EE_SLOTS;
+  ee_pos = -1;
+
+  if (!use_ram || !heat_valid(&heat_ram))
+  {
+    if (newest < 0)
+    {
+      memset(&heat_ram, 0, sizeof(heat_ram));
+      ee_dirty = false;
+      return SAVE_NONE;
+    }
+    EEPROM.get(SAVE_EE_BASE + newest * sizeof(saved_heat), heat_ram);
+    from = SAVE_EEPROM;
+  }
+  ee_dirty = (newest < 0 || heat_ram.gen != newest_gen);    // reset before the mirror was done
+
+  *seq  = heat_ram.seq;
+  *held = heat_ram.held;
+  for (int n=0; n<num_lanes && n<SAVE_LANES; n++)
+  {
+    lane_mask[n]  = heat_ram.mask & _BV(n);
+    lane_time[n]  = heat_ram.time[n];
+    lane_place[n] = heat_ram.place[n];
+  }
+
+  return from;
+}
+
+
+/*================================================================================*
+  MIRROR TO EEPROM (one byte per call, false = nothing left to write)
+ *================================================================================*/
+boolean save_service()
+{
+  if (ee_pos < 0)
+  {
+    if (!ee_dirty) return false;
+
+    heat_ee = heat_ram;
+    ee_dirty = false;
+    ee_pos = 0;
+  }
+
+  if (!eeprom_is_ready()) return true;    // previous byte still being written
+
+  EEPROM.update(SAVE_EE_BASE + ee_slot * sizeof(saved_heat) + ee_pos, ((const byte *)&heat_ee)[ee_pos]);
+
+  if (++ee_pos >= (int)sizeof(saved_heat))
+  {
+    ee_pos = -1;
+    ee_slot = (ee_slot + 1) % SAVE_EE_SLOTS;
+  }
+
+  return true;
+}
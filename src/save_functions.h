@@ -0,0 +1,20 @@
+#ifndef SAVE_VARS_H
+#define SAVE_VARS_H
+
+#include <Arduino.h>
+
+#define SAVE_LANES     8               // lanes kept (MAX_LANE)
+#define SAVE_EE_BASE   0               // first EEPROM byte used
+#define SAVE_EE_SLOTS  8               // EEPROM copies, written in turn (wear-leveling)
+
+#define SAVE_NONE      0               // restore_heat() - nothing valid
+#define SAVE_RAM       1               // from .noinit RAM (warm reset)
+#define SAVE_EEPROM    2               // from EEPROM
+
+void save_heat(unsigned int seq, int num_lanes, const unsigned long lane_time[], const int lane_place[],
+               const boolean lane_mask[], boolean held);
+byte restore_heat(boolean use_ram, unsigned int *seq, int num_lanes, unsigned long lane_time[],
+                  int lane_place[], boolean lane_mask[], boolean *held);
+boolean save_service();
+
+#endif //SAVE_VARS_H
@@ -0,0 +1,202 @@
+#include "serial_functions.h"
+
+/*================================================================================*
+  SERIAL COMMAND PARSER
+
+  Bytes are received into the HardwareSerial ring by its RX interrupt;
+  cmd_read() drains them through a small state machine and returns as soon
+  as one command is complete, leaving the rest in the ring. It never waits.
+
+  Two forms are accepted on the same stream:
+    single character     V, N, R ...   (codes in arg_codes take one digit: M3, X4)
+    framed               <M1,3,4>      (code then up to CMD_MAX_ARGS decimal numbers)
+
+  A single-character command whose digit has not arrived within CMD_ARG_WAIT
+  is returned without an argument, as is one followed by anything other
+  than a digit (that byte then starts the next command). A frame that is
+  malformed, has an argument over CMD_ARG_MAX or is not closed within
+  CMD_ARG_WAIT is returned as CMD_BAD.
+ *================================================================================*/
+#define sIDLE   0
+#define sARG    1                      // single-char command waiting for its digit
+#define sFRAME  2                      // inside <...>
+#define sSKIP   3                      // bad frame, discarding up to the closing '>'
+
+const char   *cmd_arg_codes = "";      // single-char commands that take a digit
+byte          cmd_state = sIDLE;
+command       cmd_cur;                 // command being assembled
+boolean       cmd_digits;              // current framed argument has digits
+int           cmd_hold = -1;           // byte to process again (ended a pending command)
+unsigned long cmd_t0;                  // time the pending command started
+
+
+void cmd_begin(const char *arg_codes)
+{
+  cmd_arg_codes = arg_codes;
+  cmd_state = sIDLE;
+  cmd_hold = -1;
+
+  return;
+}
+
+
+/*-----------------------------------------*
+  - finish a framed argument -
+ *-----------------------------------------*/
+boolean cmd_end_arg()
+{
+  if (!cmd_digits) return true;
+  if (cmd_cur.argc >= CMD_MAX_ARGS) return false;
+
+  cmd_cur.argc++;
+  cmd_digits = false;
+
+  return true;
+}
+
+
+/*-----------------------------------------*
+  - feed one byte (true = command complete) -
+ *-----------------------------------------*/
+boolean cmd_feed(int c)
+{
+  switch (cmd_state)
+  {
+    case sIDLE:
+      if (c == CMD_FRAME_BEG)
+      {
+        cmd_cur.code = 0;
+        cmd_cur.argc = 0;
+        cmd_cur.argv[0] = 0;
+        cmd_digits = false;
+        cmd_t0 = millis();
+        cmd_state = sFRAME;
+        return false;
+      }
+      if (c == '\r' || c == '\n' || c == ' ') return false;
+
+      cmd_cur.code = c;
+      cmd_cur.argc = 0;
+      if (c && strchr(cmd_arg_codes, c))
+      {
+        cmd_t0 = millis();
+        cmd_state = sARG;
+        return false;
+      }
+      return true;
+
+    case sARG:
+      cmd_state = sIDLE;
+      if (c >= '0' && c <= '9')
+      {
+        cmd_cur.argv[0] = c - '0';
+        cmd_cur.argc = 1;
+      }
+      else
+      {
+        cmd_hold = c;    // not an argument - it starts the next command
+      }
+      return true;
+
+    case sFRAME:
+      if (c == CMD_FRAME_END)
+      {
+        cmd_state = sIDLE;
+        if (!cmd_cur.code || !cmd_end_arg()) cmd_cur.code = CMD_BAD;
+        return true;
+      }
+      if (c == CMD_FRAME_BEG)    // unterminated frame - start over
+      {
+        cmd_hold = c;
+        cmd_state = sIDLE;
+        cmd_cur.code = CMD_BAD;
+        cmd_cur.argc = 0;
+        return true;
+      }
+      if (!cmd_cur.code)
+      {
+        if (c == ' ') return false;
+        if (c >= '0' && c <= '9')
+        {
+          cmd_state = sSKIP;
+          return false;
+        }
+        cmd_cur.code = c;
+        return false;
+      }
+      if (c >= '0' && c <= '9')
+      {
+        if (cmd_cur.argc >= CMD_MAX_ARGS)
+        {
+          cmd_state = sSKIP;
+          return false;
+        }
+        if (!cmd_digits) cmd_cur.argv[cmd_cur.argc] = 0;
+        if (cmd_cur.argv[cmd_cur.argc] > (CMD_ARG_MAX - (c - '0')) / 10)    // would overflow
+        {
+          cmd_state = sSKIP;
+          return false;
+        }
+        cmd_cur.argv[cmd_cur.argc] = cmd_cur.argv[cmd_cur.argc] * 10 + (c - '0');
+        cmd_digits = true;
+        return false;
+      }
+      if ((c == ',' || c == ' ') && cmd_end_arg()) return false;
+
+      cmd_state = sSKIP;
+      return false;
+
+    case sSKIP:
+      if (c == CMD_FRAME_BEG)    // lost the end of the bad frame - start over
+      {
+        cmd_hold = c;
+        cmd_state = sIDLE;
+        cmd_cur.code = CMD_BAD;
+        cmd_cur.argc = 0;
+        return true;
+      }
+      if (c != CMD_FRAME_END) return false;
+
+      cmd_state = sIDLE;
+      cmd_cur.code = CMD_BAD;
+      cmd_cur.argc = 0;
+      return true;
+  }
+
+  return false;
+}
+
+
+/*================================================================================*
+  READ NEXT COMPLETE COMMAND (never blocks)
+ *================================================================================*/
+boolean cmd_read(command *cmd)
+{
+  boolean done = false;
+  int c;
+
+
+  if (cmd_hold >= 0)
+  {
+    c = cmd_hold;
+    cmd_hold = -1;
+    done = cmd_feed(c);
+  }
+
+  while (!done && Serial.available() > 0)
+  {
+    done = cmd_feed(Serial.read());
+  }
+
+  if (!done && cmd_state != sIDLE && millis() - cmd_t0 > CMD_ARG_WAIT)    // gave up waiting
+  {
+    if (cmd_state != sARG) cmd_cur.code = CMD_BAD;
+    cmd_cur.argc = 0;
+    cmd_state = sIDLE;
+    done = true;
+  }
+
+  if (done) *cmd = cmd_cur;
+
+  return done;
+}
@@ -0,0 +1,22 @@
+#ifndef SERIAL_VARS_H
+#define SERIAL_VARS_H
+
+#include <Arduino.h>
+
+#define CMD_MAX_ARGS   6               // arguments in a framed command
+#define CMD_ARG_WAIT   250             // time (msecs) to wait for a command's argument or frame end
+#define CMD_FRAME_BEG  '<'             // framed command: <code arg,arg ...>
+#define CMD_FRAME_END  '>'
+#define CMD_BAD        '?'             // code returned for a framed command that did not parse
+#define CMD_ARG_MAX    0x7FFFFFFFL     // largest framed argument (a 32-bit long, as on the Uno)
+
+struct command {
+  char code;                           // command character (SMSG_*)
+  byte argc;
+  long argv[CMD_MAX_ARGS];
+};
+
+void cmd_begin(const char *arg_codes);
+boolean cmd_read(command *cmd);
+
+#endif //SERIAL_VARS_H
@@ -0,0 +1,104 @@
+#include "task_functions.h"
+
+/*================================================================================*
+  COOPERATIVE TASKS
+
+  Anything that used to delay() is a task instead: a function that is run
+  once by task_run() (called every pass of loop()) when its time comes. A
+  task that has more to do schedules itself again, keeping whatever state
+  it needs between steps, so the loop keeps servicing serial commands, the
+  reset switch and the displays in the meantime. Tasks are keyed by their
+  function; scheduling one that is already waiting just moves its time.
+  There is a slot for every task in main.cpp, so all of them can wait at
+  once. A task that finds no free slot is not run; task_dropped() counts
+  these, and the I command reports them.
+ *================================================================================*/
+struct task {
+  task_fn       fn;                    // NULL = free slot
+  unsigned long start;                 // millis() when scheduled
+  unsigned long wait;                  // msecs from start
+};
+
+task tasks[MAX_TASKS];
+unsigned int drops;                    // tasks not scheduled, no free slot
+
+
+void task_after(task_fn fn, unsigned long ms)
+{
+  int free_slot = -1;
+
+  for (int i=0; i<MAX_TASKS; i++)
+  {
+    if (tasks[i].fn == fn)
+    {
+      free_slot = i;
+      break;
+    }
+    if (!tasks[i].fn && free_slot < 0) free_slot = i;
+  }
+  if (free_slot < 0)                   // MAX_TASKS too small
+  {
+    drops++;
+    return;
+  }
+
+  tasks[free_slot].fn    = fn;
+  tasks[free_slot].start = millis();
+  tasks[free_slot].wait  = ms;
+
+  return;
+}
+
+
+void task_cancel(task_fn fn)
+{
+  for (int i=0; i<MAX_TASKS; i++)
+  {
+    if (tasks[i].fn == fn) tasks[i].fn = NULL;
+  }
+
+  return;
+}
+
+
+boolean task_pending(task_fn fn)
+{
+  for (int i=0; i<MAX_TASKS; i++)
+  {
+    if (tasks[i].fn == fn) return true;
+  }
+
+  return false;
+}
+
+
+unsigned int task_dropped()
+{
+  return drops;
+}
+
+
+/*================================================================================*
+  RUN TASKS THAT ARE DUE (at most one per call, keeps each loop pass short)
+ *================================================================================*/
+void task_run()
+{
+  static byte next = 0;
+  unsigned long now = millis();
+  task_fn fn;
+
+
+  for (int i=0; i<MAX_TASKS; i++)
+  {
+    next = (next + 1) % MAX_TASKS;
+    if (tasks[next].fn && now - tasks[next].start >= tasks[next].wait)
+    {
+      fn = tasks[next].fn;
+      tasks[next].fn = NULL;    // free before running so the task can reschedule itself
+      fn();
+      break;
+    }
+  }
+
+  return;
+}
@@ -0,0 +1,16 @@
+#ifndef TASK_VARS_H
+#define TASK_VARS_H
+
+#include <Arduino.h>
+
+#define MAX_TASKS      9               // tasks that can be waiting at once (main.cpp has 9)
+
+typedef void (*task_fn)();
+
+void task_after(task_fn fn, unsigned long ms);
+void task_cancel(task_fn fn);
+boolean task_pending(task_fn fn);
+unsigned int task_dropped();
+void task_run();
+
+#endif //TASK_VARS_H
@@ -0,0 +1,142 @@
+#include "timebase_functions.h"
+
+/*================================================================================*
+  RACE TIMEBASE
+
+  Timer1 free-runs at clk/8 (0.5 us per tick on a 16 MHz Uno) and is extended
+  to 32 bits by counting overflows, giving a 0.5 us resolution clock that
+  wraps after ~35 minutes. Elapsed times are taken by unsigned subtraction,
+  so a wrap during a heat is harmless.
+
+  Timer1 also drives analogWrite() on pins 9 and 10 (red/blue status LEDs),
+  which therefore switch fully on/off instead of being dimmed.
+ *================================================================================*/
+#ifndef NATIVE                         // the native build runs on hal_native.cpp's virtual clock
+volatile unsigned int tb_high = 0;     // Timer1 overflow count (upper 16 bits)
+
+
+ISR(TIMER1_OVF_vect)
+{
+  tb_high++;
+}
+
+
+/*================================================================================*
+  START TIMEBASE
+ *================================================================================*/
+void tb_begin()
+{
+  cli();
+  TCCR1A = 0;                          // normal mode, free running
+  TCCR1B = _BV(CS11);                  // clk/8
+  TCNT1  = 0;
+  tb_high = 0;
+  TIFR1  = _BV(TOV1);
+  TIMSK1 = _BV(TOIE1);
+  sei();
+
+  return;
+}
+
+
+/*================================================================================*
+  READ TIMEBASE (safe in interrupt context)
+ *================================================================================*/
+unsigned long tb_ticks()
+{
+  byte sreg;
+  unsigned int lo, hi;
+
+
+  sreg = SREG;
+  cli();
+
+  lo = TCNT1;
+  hi = tb_high;
+  if ((TIFR1 & _BV(TOV1)) && lo < 0x8000) hi++;    // overflow not yet serviced
+
+  SREG = sreg;
+
+  return ((unsigned long)hi << 16) | lo;
+}
+#endif
+
+
+/*-----------------------------------------*
+  - Print::printFloat() of ticks / TB_TICKS_PER_SEC (double = float on the Uno) -
+ *-----------------------------------------*/
+static char *tb_format_float(char *buf, unsigned long ticks, int digits)
+{
+  float number = (float)ticks / TB_TICKS_PER_SEC, rounding = 0.5f, remainder;
+  unsigned long int_part;
+  char *p;
+
+
+  for (int i=0; i<digits; i++) rounding /= 10.0f;
+  number += rounding;
+
+  int_part  = (unsigned long)number;
+  remainder = number - (float)int_part;
+  p = buf + sprintf(buf, "%lu", int_part);
+
+  if (digits > 0) *p++ = '.';
+  while (digits-- > 0)
+  {
+    unsigned int digit;
+
+    remainder *= 10.0f;
+    digit = (unsigned int)remainder;
+    *p++ = '0' + digit;
+    remainder -= digit;
+  }
+  *p = '\0';
+
+  return buf;
+}
+
+
+/*================================================================================*
+  FORMAT TICKS AS SECONDS
+
+  Writes "S.ddd" with the given number of decimals, the same text
+  Serial.print(secs, digits) made when times were kept as a float. The
+  tick count is rounded half up with integer math. That is what
+  printFloat() does too, except where the time is within a float step of
+  a half digit: the float is a little above or below it and rounds either
+  way. Only those times (TB_FLOAT_NEAR ticks either side of a half digit,
+  3 to 11 ticks in 200 at 4 decimals) go through printFloat()'s float
+  steps.
+  program -p 4 checks every time up to NULL_TIME against both.
+ *================================================================================*/
+char *tb_format(char *buf, unsigned long ticks, int digits)
+{
+  unsigned long scale = 1, div, half, near, units, frac;
+  char *p;
+
+
+  for (int d=0; d<digits; d++) scale *= 10;
+
+  div  = TB_TICKS_PER_SEC / scale;
+  half = div / 2;
+  near = TB_FLOAT_NEAR(ticks);
+  if (ticks % div + near >= half && ticks % div <= half + near) return tb_format_float(buf, ticks, digits);
+
+  units = (ticks + half) / div;
+  frac  = units % scale;
+
+  p = buf + sprintf(buf, "%lu", units / scale);
+
+  if (digits > 0)
+  {
+    *p++ = '.';
+    for (int d=digits-1; d>=0; d--)
+    {
+      p[d] = '0' + frac % 10;
+      frac /= 10;
+    }
+    p += digits;
+  }
+  *p = '\0';
+
+  return buf;
+}
@@ -0,0 +1,14 @@
+#ifndef TIMEBASE_VARS_H
+#define TIMEBASE_VARS_H
+
+#include <Arduino.h>
+
+#define TB_TICKS_PER_SEC  2000000UL    // Timer1 at clk/8 -> 0.5 us per tick
+#define TB_TICKS_PER_US   2
+#define TB_FLOAT_NEAR(t)  (1 + ((t) >> 22))    // ticks, over a float step of t / TB_TICKS_PER_SEC
+
+void tb_begin();
+unsigned long tb_ticks();
+char *tb_format(char *buf, unsigned long ticks, int digits);
+
+#endif //TIMEBASE_VARS_H
@@ -0,0 +1,9 @@
+#ifndef TIMER_CONFIG_H
+#define TIMER_CONFIG_H
+
+/*-----------------------------------------*
+  - lane count (main.cpp, the displays and the simulator) -
+ *-----------------------------------------*/
+#define NUM_LANES    4                 // number of lanes
+
+#endif //TIMER_CONFIG_H